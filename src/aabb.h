@@ -0,0 +1,34 @@
+#pragma once
+
+#include "raylib.h"
+#include <math.h>
+
+// -----------------------------------------------------------------------
+// scalar AABB helpers, inlined into every kernel variant
+
+static inline bool check_collision_recs(Rectangle r1, Rectangle r2) {
+    return r1.x < r2.x + r2.width && r1.x + r1.width > r2.x && r1.y < r2.y + r2.height
+           && r1.y + r1.height > r2.y;
+}
+
+// returns the axis-aligned vector pushing r1 out of r2 along the axis of
+// the smallest penetration, or zero if they don't overlap
+static inline Vector2 get_aabb_mtv(Rectangle r1, Rectangle r2) {
+    Vector2 mtv = {0.0, 0.0};
+    if (!check_collision_recs(r1, r2)) return mtv;
+
+    float x_west = r2.x - r1.x - r1.width;
+    float x_east = r2.x + r2.width - r1.x;
+    if (fabsf(x_west) < fabsf(x_east)) mtv.x = x_west;
+    else mtv.x = x_east;
+
+    float y_south = r2.y + r2.height - r1.y;
+    float y_north = r2.y - r1.y - r1.height;
+    if (fabsf(y_south) < fabsf(y_north)) mtv.y = y_south;
+    else mtv.y = y_north;
+
+    if (fabsf(mtv.x) > fabsf(mtv.y)) mtv.x = 0.0;
+    else mtv.y = 0.0;
+
+    return mtv;
+}
@@ -0,0 +1,537 @@
+#include "sim.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// -----------------------------------------------------------------------
+// benchmark suite: synthetic worlds of growing obstacle counts, with a
+// given share of static obstacles and density, timed with every
+// broadphase. per world it measures, in isolation, the platform update
+// (update_obstacles: the lod reclassification, the platform moves and
+// their reindexing), the agent collision pass (update_agent_collisions) and
+// a fan of rays from the agent (raycast_obstacles, checked against every
+// obstacle on a sample of the ticks), then whole ticks end to end; per
+// obstacle count the batch mtv kernel (get_aabb_mtv over every obstacle, no
+// broadphase)
+//
+// prints a table, and writes the results as JSON with --json, to compare
+// broadphases and catch regressions between builds
+
+// ticks (and kernel calls) per run shrink with the world size to bound
+// the total run time
+#define MAX_N_BENCH_TICKS 20000
+#define MIN_N_BENCH_TICKS 200
+#define BENCH_WORK_BUDGET (1 << 22)
+
+#define DEFAULT_MIN_N_OBSTACLES 64
+#define DEFAULT_MAX_N_OBSTACLES (1 << 20)
+#define DEFAULT_STATIC_RATIO 0.5
+// obstacles per world unit of tower height, kept constant across the
+// sizes so that the number of obstacles near the agent doesn't depend on
+// the world size
+#define DEFAULT_DENSITY 0.5
+// the timings of a single thread compare across machines
+#define DEFAULT_N_THREADS 1
+
+#define TOWER_WIDTH 40.0
+#define BENCH_OBSTACLE_WIDTH 10.0
+#define BENCH_OBSTACLE_HEIGHT 2.5
+#define BENCH_MIN_SPEED 5.0
+#define BENCH_MAX_SPEED 9.0
+
+#define AGENT_RUN_AMPLITUDE 15.0
+#define AGENT_FALL_SPEED 20.0
+
+// rays cast from the agent per tick, spread over the half turn below it
+#define BENCH_N_RAYS 8
+#define BENCH_RAY_LENGTH 64.0
+// ticks whose rays are checked against every obstacle, per world
+#define BENCH_N_RAYCAST_CHECKS 16
+
+static int MIN_N_OBSTACLES = DEFAULT_MIN_N_OBSTACLES;
+static int MAX_N_OBSTACLES = DEFAULT_MAX_N_OBSTACLES;
+static float STATIC_RATIO = DEFAULT_STATIC_RATIO;
+static float DENSITY = DEFAULT_DENSITY;
+static int N_THREADS = DEFAULT_N_THREADS;
+// all of them if -1
+static int ONLY_BROADPHASE = -1;
+static const char *JSON_PATH = NULL;
+
+// the kernel results are summed into it, so the calls can't be dropped
+static volatile int BENCH_SINK;
+
+typedef struct PhaseResult {
+    double ns_per_tick;
+    double ns_per_obstacle;
+} PhaseResult;
+
+typedef struct WorldResult {
+    Broadphase broadphase;
+    int n_obstacles;
+    int n_static;
+    int n_moving;
+    int n_ticks;
+    double load_ms;
+
+    PhaseResult update_obstacles;
+    PhaseResult collisions;
+    PhaseResult raycasts;
+    // rays whose hit differs from the one over every obstacle
+    int n_raycast_mismatches;
+    PhaseResult tick;
+    double ticks_per_sec;
+} WorldResult;
+
+typedef struct KernelResult {
+    int n_obstacles;
+    int n_calls;
+    double ns_per_call;
+    double ns_per_obstacle;
+} KernelResult;
+
+// -----------------------------------------------------------------------
+// utils
+static double get_time(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int get_n_bench_ticks(int n_obstacles) {
+    int n_ticks = BENCH_WORK_BUDGET / n_obstacles;
+    n_ticks = n_ticks > MAX_N_BENCH_TICKS ? MAX_N_BENCH_TICKS : n_ticks;
+    return n_ticks < MIN_N_BENCH_TICKS ? MIN_N_BENCH_TICKS : n_ticks;
+}
+
+static PhaseResult get_phase_result(double elapsed, int n_ticks, int n_obstacles) {
+    double ns_per_tick = 1e9 * elapsed / n_ticks;
+    return (PhaseResult){
+        .ns_per_tick = ns_per_tick,
+        .ns_per_obstacle = n_obstacles > 0 ? ns_per_tick / n_obstacles : 0.0,
+    };
+}
+
+// -----------------------------------------------------------------------
+// host
+uint32_t get_no_input(void *user, int agent) {
+    return 0;
+}
+
+float get_tick_frame_time(void *user) {
+    return get_tick_dt();
+}
+
+// -----------------------------------------------------------------------
+// world
+// tower of obstacles, the moving ones go left and right across it; a
+// share of STATIC_RATIO is static, spread evenly over the indices
+void load_bench_world(int n_obstacles) {
+    seed_random(1);
+    load_game();
+    reset_obstacles();
+    clear_tower();
+
+    int n_moving = n_obstacles - (int)(STATIC_RATIO * n_obstacles);
+    float *width = malloc(n_moving * sizeof(float));
+    float *height = malloc(n_moving * sizeof(float));
+    Vector2 *start = malloc(n_moving * sizeof(Vector2));
+    Vector2 *direction = malloc(n_moving * sizeof(Vector2));
+    float *length = malloc(n_moving * sizeof(float));
+    double *phase = malloc(n_moving * sizeof(double));
+    float *speed = malloc(n_moving * sizeof(float));
+
+    float tower_height = n_obstacles / DENSITY;
+    float x_min = -0.5 * TOWER_WIDTH;
+    float x_max = 0.5 * TOWER_WIDTH - BENCH_OBSTACLE_WIDTH;
+    int n_spawned = 0;
+    for (int i = 0; i < n_obstacles; ++i) {
+        float x = randf_min_max(x_min, x_max);
+        float y = -randf() * tower_height;
+
+        // moving while the moving share of the first i + 1 obstacles
+        // isn't spawned yet
+        bool is_moving = n_spawned < (int64_t)n_moving * (i + 1) / n_obstacles;
+        if (!is_moving) {
+            Rectangle rect = {x, y, BENCH_OBSTACLE_WIDTH, BENCH_OBSTACLE_HEIGHT};
+            spawn_static_obstacle(rect);
+            continue;
+        }
+
+        int j = n_spawned++;
+        width[j] = BENCH_OBSTACLE_WIDTH;
+        height[j] = BENCH_OBSTACLE_HEIGHT;
+        start[j] = (Vector2){x_min, y};
+        direction[j] = (Vector2){1.0, 0.0};
+        length[j] = x_max - x_min;
+        phase[j] = x - x_min;
+        speed[j] = randf_min_max(BENCH_MIN_SPEED, BENCH_MAX_SPEED);
+    }
+    spawn_platforms(n_moving, width, height, start, direction, length, phase, speed);
+    build_static_obstacles();
+
+    free(width);
+    free(height);
+    free(start);
+    free(direction);
+    free(length);
+    free(phase);
+    free(speed);
+}
+
+// the agent runs and falls through the tower at game speeds, so the
+// broadphases relying on coherence are measured the way they're used
+void move_bench_agent(int tick, float dt, float tower_height) {
+    float t = tick * dt;
+    AGENTS.x[0] = AGENT_RUN_AMPLITUDE * sinf(t);
+    AGENTS.y[0] = -tower_height + fmodf(AGENT_FALL_SPEED * t, tower_height);
+    AGENTS.velocity_x[0] = 0.0;
+    AGENTS.velocity_y[0] = AGENT_FALL_SPEED;
+}
+
+Vector2 get_bench_ray_end(Vector2 start, int ray) {
+    float angle = PI * ((ray + 0.5) / BENCH_N_RAYS - 0.5);
+    return (Vector2){
+        start.x + BENCH_RAY_LENGTH * sinf(angle),
+        start.y + BENCH_RAY_LENGTH * cosf(angle),
+    };
+}
+
+// the closest hit over every obstacle, what raycast_obstacles must find
+float get_linear_raycast_fraction(Vector2 start, Vector2 end) {
+    float fraction = 1.0;
+    for (int i = 0; i < STATIC_OBSTACLES.n; ++i) {
+        BvhAabb aabb = get_rect_aabb(get_static_obstacle_rect(i));
+        raycast_aabb(aabb, start, end, fraction, &fraction);
+    }
+    for (int i = 0; i < OBSTACLES.n; ++i) {
+        BvhAabb aabb = get_rect_aabb(get_obstacle_rect(i));
+        raycast_aabb(aabb, start, end, fraction, &fraction);
+    }
+    return fraction;
+}
+
+// -----------------------------------------------------------------------
+// benchmarks
+WorldResult bench_world(int n_obstacles) {
+    WorldResult result = {.broadphase = BROADPHASE, .n_obstacles = n_obstacles};
+
+    double load_start_time = get_time();
+    load_bench_world(n_obstacles);
+    result.load_ms = 1e3 * (get_time() - load_start_time);
+    result.n_static = STATIC_OBSTACLES.n;
+    result.n_moving = OBSTACLES.n;
+
+    int n_ticks = get_n_bench_ticks(n_obstacles);
+    result.n_ticks = n_ticks;
+    float dt = get_tick_dt();
+    float tower_height = n_obstacles / DENSITY;
+
+    // the phases one by one, with the tick count and the agent where tick
+    // has them, so the lod pass reindexes the platforms the agent passes
+    double update_elapsed = 0.0;
+    double collisions_elapsed = 0.0;
+    double raycasts_elapsed = 0.0;
+    int check_interval = n_ticks > BENCH_N_RAYCAST_CHECKS
+                             ? n_ticks / BENCH_N_RAYCAST_CHECKS
+                             : 1;
+    for (int i = 0; i < n_ticks; ++i) {
+        N_TICKS = i + 1;
+        move_bench_agent(i, dt, tower_height);
+        double start_time = get_time();
+        update_obstacles(get_world_time());
+        update_elapsed += get_time() - start_time;
+
+        start_time = get_time();
+        update_agent_collisions();
+        collisions_elapsed += get_time() - start_time;
+
+        Vector2 ray_start = get_agent_position(0);
+        float fractions[BENCH_N_RAYS];
+        bool is_static;
+        start_time = get_time();
+        for (int ray = 0; ray < BENCH_N_RAYS; ++ray) {
+            Vector2 ray_end = get_bench_ray_end(ray_start, ray);
+            raycast_obstacles(ray_start, ray_end, &fractions[ray], &is_static);
+        }
+        raycasts_elapsed += get_time() - start_time;
+
+        if (i % check_interval != 0) continue;
+        for (int ray = 0; ray < BENCH_N_RAYS; ++ray) {
+            Vector2 ray_end = get_bench_ray_end(ray_start, ray);
+            float fraction = get_linear_raycast_fraction(ray_start, ray_end);
+            if (fraction != fractions[ray]) result.n_raycast_mismatches += 1;
+        }
+    }
+    result.update_obstacles = get_phase_result(update_elapsed, n_ticks, result.n_moving);
+    result.collisions = get_phase_result(collisions_elapsed, n_ticks, n_obstacles);
+    result.raycasts = get_phase_result(raycasts_elapsed, n_ticks, n_obstacles);
+
+    // whole ticks on a fresh world, with the agent put on the same course
+    // before each one
+    load_bench_world(n_obstacles);
+    double tick_elapsed = 0.0;
+    for (int i = 0; i < n_ticks; ++i) {
+        move_bench_agent(i, dt, tower_height);
+        double start_time = get_time();
+        tick(dt);
+        tick_elapsed += get_time() - start_time;
+    }
+    result.tick = get_phase_result(tick_elapsed, n_ticks, n_obstacles);
+    result.ticks_per_sec = n_ticks / tick_elapsed;
+
+    return result;
+}
+
+// the kernel over the whole world, as the linear broadphase runs it
+KernelResult bench_mtv_kernel(int n_obstacles) {
+    load_bench_world(n_obstacles);
+
+    int n = STATIC_OBSTACLES.n > OBSTACLES.n ? STATIC_OBSTACLES.n : OBSTACLES.n;
+    float *mtv_y = malloc((n > 0 ? n : 1) * sizeof(float));
+    int n_calls = get_n_bench_ticks(n_obstacles);
+    float tower_height = n_obstacles / DENSITY;
+    float dt = get_tick_dt();
+
+    int n_overlaps = 0;
+    double start_time = get_time();
+    for (int i = 0; i < n_calls; ++i) {
+        move_bench_agent(i, dt, tower_height);
+        Rectangle rect = get_agent_rect(0);
+        MtvBounds bounds = KERNELS->get_aabb_mtv_batch(
+            rect,
+            STATIC_OBSTACLES.x,
+            STATIC_OBSTACLES.y,
+            STATIC_OBSTACLES.width,
+            STATIC_OBSTACLES.height,
+            STATIC_OBSTACLES.n,
+            mtv_y
+        );
+        n_overlaps += bounds.n_overlaps;
+        bounds = KERNELS->get_aabb_mtv_batch(
+            rect,
+            OBSTACLES.x,
+            OBSTACLES.y,
+            OBSTACLES.width,
+            OBSTACLES.height,
+            OBSTACLES.n,
+            mtv_y
+        );
+        n_overlaps += bounds.n_overlaps;
+    }
+    double elapsed = get_time() - start_time;
+    BENCH_SINK += n_overlaps;
+    free(mtv_y);
+
+    double ns_per_call = 1e9 * elapsed / n_calls;
+    return (KernelResult){
+        .n_obstacles = n_obstacles,
+        .n_calls = n_calls,
+        .ns_per_call = ns_per_call,
+        .ns_per_obstacle = ns_per_call / n_obstacles,
+    };
+}
+
+// -----------------------------------------------------------------------
+// output
+void print_world_result(const WorldResult *result) {
+    printf(
+        "%-10s %-12d %14.1f %14.1f %14.1f %14.1f %12.0f\n",
+        get_broadphase_name(result->broadphase),
+        result->n_obstacles,
+        result->update_obstacles.ns_per_tick,
+        result->collisions.ns_per_tick,
+        result->raycasts.ns_per_tick,
+        result->tick.ns_per_tick,
+        result->ticks_per_sec
+    );
+}
+
+void write_phase_json(FILE *file, const char *name, PhaseResult phase) {
+    fprintf(
+        file,
+        "\"%s\": {\"ns_per_tick\": %.3f, \"ns_per_obstacle\": %.6f}",
+        name,
+        phase.ns_per_tick,
+        phase.ns_per_obstacle
+    );
+}
+
+bool write_json(
+    const char *path,
+    const WorldResult *worlds,
+    int n_worlds,
+    const KernelResult *kernels,
+    int n_kernels
+) {
+    FILE *file = fopen(path, "w");
+    if (file == NULL) return false;
+
+    fprintf(file, "{\n");
+    fprintf(file, "  \"isa\": \"%s\",\n", KERNELS->name);
+    fprintf(file, "  \"threads\": %d,\n", get_n_job_workers());
+    fprintf(file, "  \"tick_rate\": %d,\n", TICK_RATE);
+    fprintf(file, "  \"static_ratio\": %.6g,\n", STATIC_RATIO);
+    fprintf(file, "  \"density\": %.6g,\n", DENSITY);
+
+    fprintf(file, "  \"worlds\": [\n");
+    for (int i = 0; i < n_worlds; ++i) {
+        const WorldResult *result = &worlds[i];
+        fprintf(
+            file,
+            "    {\"broadphase\": \"%s\", \"n_obstacles\": %d, \"n_static\": %d, "
+            "\"n_moving\": %d, \"n_ticks\": %d, \"load_ms\": %.3f, ",
+            get_broadphase_name(result->broadphase),
+            result->n_obstacles,
+            result->n_static,
+            result->n_moving,
+            result->n_ticks,
+            result->load_ms
+        );
+        write_phase_json(file, "update_obstacles", result->update_obstacles);
+        fprintf(file, ", ");
+        write_phase_json(file, "collisions", result->collisions);
+        fprintf(file, ", ");
+        write_phase_json(file, "raycasts", result->raycasts);
+        fprintf(file, ", \"raycast_mismatches\": %d, ", result->n_raycast_mismatches);
+        write_phase_json(file, "tick", result->tick);
+        fprintf(file, ", \"ticks_per_sec\": %.1f}", result->ticks_per_sec);
+        fprintf(file, i + 1 < n_worlds ? ",\n" : "\n");
+    }
+    fprintf(file, "  ],\n");
+
+    fprintf(file, "  \"mtv_kernel\": [\n");
+    for (int i = 0; i < n_kernels; ++i) {
+        const KernelResult *result = &kernels[i];
+        fprintf(
+            file,
+            "    {\"n_obstacles\": %d, \"n_calls\": %d, \"ns_per_call\": %.3f, "
+            "\"ns_per_obstacle\": %.6f}%s\n",
+            result->n_obstacles,
+            result->n_calls,
+            result->ns_per_call,
+            result->ns_per_obstacle,
+            i + 1 < n_kernels ? "," : ""
+        );
+    }
+    fprintf(file, "  ]\n");
+    fprintf(file, "}\n");
+
+    return fclose(file) == 0;
+}
+
+// -----------------------------------------------------------------------
+// main
+// usage: platforms_bench [--isa scalar|sse4.1|avx2|avx512]
+//                        [--broadphase linear|grid|bvh|sap (default: all)]
+//                        [--min-obstacles N] [--max-obstacles N]
+//                        [--static-ratio R (0..1)] [--density D]
+//                        [--threads N (0 = one per cpu)] [--json FILE]
+// the obstacle counts go from min to max by factors of 4
+void parse_args(int argc, char **argv) {
+    for (int i = 1; i < argc - 1; ++i) {
+        if (strcmp(argv[i], "--isa") == 0) {
+            const char *name = argv[++i];
+            if (!select_kernels(name)) fprintf(stderr, "unsupported isa: %s\n", name);
+        } else if (strcmp(argv[i], "--broadphase") == 0) {
+            const char *name = argv[++i];
+            for (int b = 0; b < N_BROADPHASES; ++b) {
+                if (strcmp(name, get_broadphase_name(b)) == 0) ONLY_BROADPHASE = b;
+            }
+        } else if (strcmp(argv[i], "--min-obstacles") == 0) {
+            MIN_N_OBSTACLES = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--max-obstacles") == 0) {
+            MAX_N_OBSTACLES = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--static-ratio") == 0) {
+            STATIC_RATIO = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--density") == 0) {
+            DENSITY = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--threads") == 0) {
+            N_THREADS = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--json") == 0) {
+            JSON_PATH = argv[++i];
+        }
+    }
+
+    if (MIN_N_OBSTACLES <= 0) MIN_N_OBSTACLES = DEFAULT_MIN_N_OBSTACLES;
+    if (MAX_N_OBSTACLES < MIN_N_OBSTACLES) MAX_N_OBSTACLES = MIN_N_OBSTACLES;
+    bool is_static_ratio_valid = STATIC_RATIO >= 0.0 && STATIC_RATIO <= 1.0;
+    if (!is_static_ratio_valid) STATIC_RATIO = DEFAULT_STATIC_RATIO;
+    if (!(DENSITY > 0.0)) DENSITY = DEFAULT_DENSITY;
+    if (N_THREADS < 0) N_THREADS = DEFAULT_N_THREADS;
+}
+
+int main(int argc, char **argv) {
+    init_kernels();
+    parse_args(argc, argv);
+    init_job_pool(N_THREADS);
+
+    SIM_HOST = (SimHost){
+        .user = NULL,
+        .get_input = get_no_input,
+        .get_frame_time = get_tick_frame_time,
+    };
+
+    int n_sizes = 0;
+    for (int64_t n = MIN_N_OBSTACLES; n <= MAX_N_OBSTACLES; n *= 4) n_sizes += 1;
+    WorldResult *worlds = malloc(N_BROADPHASES * n_sizes * sizeof(WorldResult));
+    KernelResult *kernels = malloc(n_sizes * sizeof(KernelResult));
+    int n_worlds = 0;
+    int n_kernels = 0;
+    int n_raycast_mismatches = 0;
+
+    printf("isa: %s\n", KERNELS->name);
+    printf("threads: %d\n", get_n_job_workers());
+    printf("static ratio: %.2f, density: %.2f\n", STATIC_RATIO, DENSITY);
+    printf(
+        "%-10s %-12s %14s %14s %14s %14s %12s\n",
+        "broadphase",
+        "n_obstacles",
+        "update ns/tick",
+        "collide ns",
+        "raycast ns",
+        "tick ns",
+        "ticks/sec"
+    );
+    for (int b = 0; b < N_BROADPHASES; ++b) {
+        if (ONLY_BROADPHASE != -1 && b != ONLY_BROADPHASE) continue;
+        BROADPHASE = b;
+        for (int64_t n = MIN_N_OBSTACLES; n <= MAX_N_OBSTACLES; n *= 4) {
+            worlds[n_worlds] = bench_world(n);
+            print_world_result(&worlds[n_worlds]);
+            n_raycast_mismatches += worlds[n_worlds].n_raycast_mismatches;
+            n_worlds += 1;
+        }
+    }
+
+    printf("%-10s %-12s %14s %14s\n", "kernel", "n_obstacles", "ns/call", "ns/obstacle");
+    BROADPHASE = BROADPHASE_LINEAR;
+    for (int64_t n = MIN_N_OBSTACLES; n <= MAX_N_OBSTACLES; n *= 4) {
+        KernelResult *result = &kernels[n_kernels++];
+        *result = bench_mtv_kernel(n);
+        printf(
+            "%-10s %-12d %14.1f %14.3f\n",
+            "mtv",
+            result->n_obstacles,
+            result->ns_per_call,
+            result->ns_per_obstacle
+        );
+    }
+
+    bool is_written = true;
+    if (JSON_PATH) {
+        is_written = write_json(JSON_PATH, worlds, n_worlds, kernels, n_kernels);
+        if (!is_written) fprintf(stderr, "can't write %s\n", JSON_PATH);
+    }
+
+    if (n_raycast_mismatches > 0) {
+        fprintf(stderr, "%d rays missed their closest hit\n", n_raycast_mismatches);
+    }
+
+    free(worlds);
+    free(kernels);
+    free_tower();
+    free_job_pool();
+    return is_written && n_raycast_mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,513 @@
+#include "bvh.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+// query stack kept on the stack, deeper trees get one from the heap
+#define BVH_STACK_SIZE 256
+
+// -----------------------------------------------------------------------
+// aabb
+BvhAabb get_rect_aabb(Rectangle rect) {
+    return (BvhAabb){
+        .min_x = rect.x,
+        .min_y = rect.y,
+        .max_x = rect.x + rect.width,
+        .max_y = rect.y + rect.height,
+    };
+}
+
+static BvhAabb get_fat_aabb(Rectangle rect) {
+    BvhAabb aabb = get_rect_aabb(rect);
+    aabb.min_x -= BVH_FAT_MARGIN;
+    aabb.min_y -= BVH_FAT_MARGIN;
+    aabb.max_x += BVH_FAT_MARGIN;
+    aabb.max_y += BVH_FAT_MARGIN;
+    return aabb;
+}
+
+static BvhAabb get_union_aabb(BvhAabb a, BvhAabb b) {
+    return (BvhAabb){
+        .min_x = fminf(a.min_x, b.min_x),
+        .min_y = fminf(a.min_y, b.min_y),
+        .max_x = fmaxf(a.max_x, b.max_x),
+        .max_y = fmaxf(a.max_y, b.max_y),
+    };
+}
+
+// the 2d counterpart of the surface area heuristic
+static float get_aabb_perimeter(BvhAabb aabb) {
+    return 2.0 * ((aabb.max_x - aabb.min_x) + (aabb.max_y - aabb.min_y));
+}
+
+static bool is_aabb_contains(BvhAabb outer, BvhAabb inner) {
+    return outer.min_x <= inner.min_x && outer.min_y <= inner.min_y
+           && outer.max_x >= inner.max_x && outer.max_y >= inner.max_y;
+}
+
+bool is_aabb_overlap(BvhAabb a, BvhAabb b) {
+    return a.min_x < b.max_x && a.max_x > b.min_x && a.min_y < b.max_y
+           && a.max_y > b.min_y;
+}
+
+// slab test of the start -> end segment
+// out_fraction is the entry point as a fraction of the segment
+bool raycast_aabb(
+    BvhAabb aabb, Vector2 start, Vector2 end, float max_fraction, float *out_fraction
+) {
+    float t_min = 0.0;
+    float t_max = max_fraction;
+
+    float origin[2] = {start.x, start.y};
+    float delta[2] = {end.x - start.x, end.y - start.y};
+    float box_min[2] = {aabb.min_x, aabb.min_y};
+    float box_max[2] = {aabb.max_x, aabb.max_y};
+    for (int axis = 0; axis < 2; ++axis) {
+        if (fabsf(delta[axis]) < 1e-9) {
+            if (origin[axis] < box_min[axis] || origin[axis] > box_max[axis]) return false;
+            continue;
+        }
+
+        float inv_delta = 1.0 / delta[axis];
+        float t1 = (box_min[axis] - origin[axis]) * inv_delta;
+        float t2 = (box_max[axis] - origin[axis]) * inv_delta;
+        if (t1 > t2) {
+            float t = t1;
+            t1 = t2;
+            t2 = t;
+        }
+
+        t_min = fmaxf(t_min, t1);
+        t_max = fminf(t_max, t2);
+        if (t_min > t_max) return false;
+    }
+
+    *out_fraction = t_min;
+    return true;
+}
+
+// -----------------------------------------------------------------------
+// nodes
+static bool is_leaf(BvhNode *node) {
+    return node->left == BVH_NULL_NODE;
+}
+
+static int allocate_node(Bvh *bvh) {
+    if (bvh->free_node == BVH_NULL_NODE) {
+        int capacity = bvh->capacity ? 2 * bvh->capacity : 64;
+        bvh->nodes = realloc(bvh->nodes, capacity * sizeof(BvhNode));
+        for (int i = bvh->capacity; i < capacity; ++i) {
+            bvh->nodes[i].parent = i + 1 < capacity ? i + 1 : BVH_NULL_NODE;
+            bvh->nodes[i].height = -1;
+        }
+        bvh->free_node = bvh->capacity;
+        bvh->capacity = capacity;
+    }
+
+    int idx = bvh->free_node;
+    BvhNode *node = &bvh->nodes[idx];
+    bvh->free_node = node->parent;
+    *node = (BvhNode){
+        .parent = BVH_NULL_NODE,
+        .left = BVH_NULL_NODE,
+        .right = BVH_NULL_NODE,
+        .height = 0,
+        .id = -1,
+    };
+    bvh->n_nodes += 1;
+
+    return idx;
+}
+
+static void free_node(Bvh *bvh, int idx) {
+    bvh->nodes[idx].parent = bvh->free_node;
+    bvh->nodes[idx].height = -1;
+    bvh->free_node = idx;
+    bvh->n_nodes -= 1;
+}
+
+static void replace_child(Bvh *bvh, int parent, int old_child, int new_child) {
+    if (parent == BVH_NULL_NODE) {
+        bvh->root = new_child;
+    } else if (bvh->nodes[parent].left == old_child) {
+        bvh->nodes[parent].left = new_child;
+    } else {
+        bvh->nodes[parent].right = new_child;
+    }
+}
+
+static void refit_node(Bvh *bvh, int idx) {
+    BvhNode *node = &bvh->nodes[idx];
+    BvhNode *left = &bvh->nodes[node->left];
+    BvhNode *right = &bvh->nodes[node->right];
+    node->aabb = get_union_aabb(left->aabb, right->aabb);
+    node->height = 1 + (left->height > right->height ? left->height : right->height);
+}
+
+// rotates the higher child of an unbalanced node up
+// returns the node now standing at the idx place
+static int balance_node(Bvh *bvh, int a_idx) {
+    BvhNode *a = &bvh->nodes[a_idx];
+    if (is_leaf(a) || a->height < 2) return a_idx;
+
+    int b_idx = a->left;
+    int c_idx = a->right;
+    int balance = bvh->nodes[c_idx].height - bvh->nodes[b_idx].height;
+    if (balance >= -1 && balance <= 1) return a_idx;
+
+    // p is the higher child, q its sibling; p goes up, a becomes its child
+    // and takes the lower grandchild in place of p
+    int p_idx = balance > 1 ? c_idx : b_idx;
+    BvhNode *p = &bvh->nodes[p_idx];
+    int f_idx = p->left;
+    int g_idx = p->right;
+
+    p->left = a_idx;
+    p->parent = a->parent;
+    a->parent = p_idx;
+    replace_child(bvh, p->parent, a_idx, p_idx);
+
+    int keep_idx = f_idx;
+    int move_idx = g_idx;
+    if (bvh->nodes[f_idx].height < bvh->nodes[g_idx].height) {
+        keep_idx = g_idx;
+        move_idx = f_idx;
+    }
+
+    p->right = keep_idx;
+    if (balance > 1) a->right = move_idx;
+    else a->left = move_idx;
+    bvh->nodes[move_idx].parent = a_idx;
+
+    refit_node(bvh, a_idx);
+    refit_node(bvh, p_idx);
+
+    return p_idx;
+}
+
+static void refit_ancestors(Bvh *bvh, int idx) {
+    while (idx != BVH_NULL_NODE) {
+        idx = balance_node(bvh, idx);
+        refit_node(bvh, idx);
+        idx = bvh->nodes[idx].parent;
+    }
+}
+
+// descends by the cheapest perimeter increase (branch and bound as in
+// Box2D's b2DynamicTree)
+static int find_best_sibling(Bvh *bvh, BvhAabb aabb) {
+    int idx = bvh->root;
+    while (!is_leaf(&bvh->nodes[idx])) {
+        BvhNode *node = &bvh->nodes[idx];
+
+        float perimeter = get_aabb_perimeter(node->aabb);
+        float combined_perimeter = get_aabb_perimeter(get_union_aabb(node->aabb, aabb));
+
+        // cost of creating a new parent for this node and the new leaf
+        float cost = 2.0 * combined_perimeter;
+
+        // minimum cost of pushing the leaf further down the tree
+        float inheritance_cost = 2.0 * (combined_perimeter - perimeter);
+
+        float child_costs[2];
+        int children[2] = {node->left, node->right};
+        for (int i = 0; i < 2; ++i) {
+            BvhNode *child = &bvh->nodes[children[i]];
+            float child_perimeter = get_aabb_perimeter(get_union_aabb(child->aabb, aabb));
+            if (!is_leaf(child)) child_perimeter -= get_aabb_perimeter(child->aabb);
+            child_costs[i] = child_perimeter + inheritance_cost;
+        }
+
+        if (cost < child_costs[0] && cost < child_costs[1]) break;
+        idx = child_costs[0] < child_costs[1] ? children[0] : children[1];
+    }
+
+    return idx;
+}
+
+static void insert_leaf(Bvh *bvh, int leaf) {
+    if (bvh->root == BVH_NULL_NODE) {
+        bvh->root = leaf;
+        bvh->nodes[leaf].parent = BVH_NULL_NODE;
+        return;
+    }
+
+    // allocate first, it may move the nodes
+    int new_parent = allocate_node(bvh);
+
+    BvhAabb aabb = bvh->nodes[leaf].aabb;
+    int sibling = find_best_sibling(bvh, aabb);
+    int old_parent = bvh->nodes[sibling].parent;
+
+    BvhNode *parent = &bvh->nodes[new_parent];
+    parent->parent = old_parent;
+    parent->left = sibling;
+    parent->right = leaf;
+    replace_child(bvh, old_parent, sibling, new_parent);
+    bvh->nodes[sibling].parent = new_parent;
+    bvh->nodes[leaf].parent = new_parent;
+
+    refit_ancestors(bvh, new_parent);
+}
+
+static void remove_leaf(Bvh *bvh, int leaf) {
+    if (leaf == bvh->root) {
+        bvh->root = BVH_NULL_NODE;
+        return;
+    }
+
+    int parent = bvh->nodes[leaf].parent;
+    int grand_parent = bvh->nodes[parent].parent;
+    int sibling = bvh->nodes[parent].left == leaf ? bvh->nodes[parent].right
+                                                   : bvh->nodes[parent].left;
+
+    replace_child(bvh, grand_parent, parent, sibling);
+    bvh->nodes[sibling].parent = grand_parent;
+    free_node(bvh, parent);
+
+    refit_ancestors(bvh, grand_parent);
+}
+
+// -----------------------------------------------------------------------
+// tree
+void reset_bvh(Bvh *bvh) {
+    bvh->root = BVH_NULL_NODE;
+    bvh->n_nodes = 0;
+
+    // chain all the nodes into the free list again
+    for (int i = 0; i < bvh->capacity; ++i) {
+        bvh->nodes[i].parent = i + 1 < bvh->capacity ? i + 1 : BVH_NULL_NODE;
+        bvh->nodes[i].height = -1;
+    }
+    bvh->free_node = bvh->capacity ? 0 : BVH_NULL_NODE;
+
+    for (int i = 0; i < bvh->n_ids; ++i) {
+        bvh->leaves[i] = BVH_NULL_NODE;
+    }
+}
+
+void free_bvh(Bvh *bvh) {
+    free(bvh->nodes);
+    free(bvh->leaves);
+    *bvh = (Bvh){0};
+    bvh->root = BVH_NULL_NODE;
+    bvh->free_node = BVH_NULL_NODE;
+}
+
+static void reserve_bvh_ids(Bvh *bvh, int n_ids) {
+    if (n_ids <= bvh->n_ids) return;
+
+    int n = bvh->n_ids ? bvh->n_ids : 64;
+    while (n < n_ids) n *= 2;
+
+    bvh->leaves = realloc(bvh->leaves, n * sizeof(int));
+    for (int i = bvh->n_ids; i < n; ++i) {
+        bvh->leaves[i] = BVH_NULL_NODE;
+    }
+    bvh->n_ids = n;
+}
+
+void insert_bvh_item(Bvh *bvh, int id, Rectangle rect) {
+    reserve_bvh_ids(bvh, id + 1);
+    if (bvh->leaves[id] != BVH_NULL_NODE) remove_bvh_item(bvh, id);
+
+    int leaf = allocate_node(bvh);
+    bvh->nodes[leaf].aabb = get_fat_aabb(rect);
+    bvh->nodes[leaf].id = id;
+    bvh->leaves[id] = leaf;
+
+    insert_leaf(bvh, leaf);
+}
+
+// leaf of a bulk build with its center (doubled), packed so the splits
+// don't chase the nodes
+typedef struct BuildLeaf {
+    float center[2];
+    int node;
+} BuildLeaf;
+
+// partially sorts leaves[begin..end) by the axis center, so that the
+// median is in place with the smaller centers before it
+static void select_median_leaf(BuildLeaf *leaves, int axis, int begin, int end) {
+    int median = begin + (end - begin) / 2;
+    int lo = begin;
+    int hi = end - 1;
+    while (lo < hi) {
+        float pivot = leaves[lo + (hi - lo) / 2].center[axis];
+        int i = lo;
+        int j = hi;
+        while (i <= j) {
+            while (leaves[i].center[axis] < pivot) ++i;
+            while (leaves[j].center[axis] > pivot) --j;
+            if (i <= j) {
+                BuildLeaf t = leaves[i];
+                leaves[i++] = leaves[j];
+                leaves[j--] = t;
+            }
+        }
+
+        if (median <= j) hi = j;
+        else if (median >= i) lo = i;
+        else break;
+    }
+}
+
+// builds a balanced subtree over the leaves by median splits along the
+// longer extent of their centers, returns its root
+static int build_subtree(Bvh *bvh, BuildLeaf *leaves, int begin, int end) {
+    if (end - begin == 1) return leaves[begin].node;
+
+    float min[2] = {INFINITY, INFINITY};
+    float max[2] = {-INFINITY, -INFINITY};
+    for (int i = begin; i < end; ++i) {
+        for (int axis = 0; axis < 2; ++axis) {
+            min[axis] = fminf(min[axis], leaves[i].center[axis]);
+            max[axis] = fmaxf(max[axis], leaves[i].center[axis]);
+        }
+    }
+    int axis = max[0] - min[0] >= max[1] - min[1] ? 0 : 1;
+    int median = begin + (end - begin) / 2;
+    select_median_leaf(leaves, axis, begin, end);
+
+    int left = build_subtree(bvh, leaves, begin, median);
+    int right = build_subtree(bvh, leaves, median, end);
+
+    // allocated after the children, it may move the nodes
+    int idx = allocate_node(bvh);
+    BvhNode *node = &bvh->nodes[idx];
+    node->left = left;
+    node->right = right;
+    bvh->nodes[left].parent = idx;
+    bvh->nodes[right].parent = idx;
+    refit_node(bvh, idx);
+
+    return idx;
+}
+
+// inserts the items first_id to first_id + n - 1, an empty tree is built
+// top-down in one pass (balanced, far faster than n insertions), a tree
+// with items already gets them one by one
+void insert_bvh_items(
+    Bvh *bvh,
+    int first_id,
+    int n,
+    const float *x,
+    const float *y,
+    const float *width,
+    const float *height
+) {
+    if (bvh->root != BVH_NULL_NODE) {
+        for (int i = 0; i < n; ++i) {
+            Rectangle rect = {x[i], y[i], width[i], height[i]};
+            insert_bvh_item(bvh, first_id + i, rect);
+        }
+        return;
+    }
+    if (n == 0) return;
+
+    reserve_bvh_ids(bvh, first_id + n);
+    BuildLeaf *leaves = malloc(n * sizeof(BuildLeaf));
+    for (int i = 0; i < n; ++i) {
+        int id = first_id + i;
+        Rectangle rect = {x[i], y[i], width[i], height[i]};
+        int leaf = allocate_node(bvh);
+        bvh->nodes[leaf].aabb = get_fat_aabb(rect);
+        bvh->nodes[leaf].id = id;
+        bvh->leaves[id] = leaf;
+        leaves[i] = (BuildLeaf){
+            .center = {2.0 * x[i] + width[i], 2.0 * y[i] + height[i]},
+            .node = leaf,
+        };
+    }
+
+    bvh->root = build_subtree(bvh, leaves, 0, n);
+    bvh->nodes[bvh->root].parent = BVH_NULL_NODE;
+    free(leaves);
+}
+
+// returns true if the item left its fat AABB and was reinserted
+bool update_bvh_item(Bvh *bvh, int id, Rectangle rect) {
+    int leaf = bvh->leaves[id];
+    if (is_aabb_contains(bvh->nodes[leaf].aabb, get_rect_aabb(rect))) return false;
+
+    remove_leaf(bvh, leaf);
+    bvh->nodes[leaf].aabb = get_fat_aabb(rect);
+    insert_leaf(bvh, leaf);
+
+    return true;
+}
+
+void remove_bvh_item(Bvh *bvh, int id) {
+    if (id >= bvh->n_ids || bvh->leaves[id] == BVH_NULL_NODE) return;
+
+    int leaf = bvh->leaves[id];
+    remove_leaf(bvh, leaf);
+    free_node(bvh, leaf);
+    bvh->leaves[id] = BVH_NULL_NODE;
+}
+
+// a walk depth first, pushing both children, holds at most one node per
+// level plus one
+static int *get_query_stack(Bvh *bvh, int *local_stack) {
+    int max_n_stack = bvh->nodes[bvh->root].height + 1;
+    if (max_n_stack <= BVH_STACK_SIZE) return local_stack;
+    return malloc(max_n_stack * sizeof(int));
+}
+
+// writes ids of the items whose fat AABBs overlap the rect into out_ids
+// returns the number of ids written (at most max_n_ids)
+int query_bvh(Bvh *bvh, Rectangle rect, int *out_ids, int max_n_ids) {
+    if (bvh->root == BVH_NULL_NODE) return 0;
+
+    int local_stack[BVH_STACK_SIZE];
+    int *stack = get_query_stack(bvh, local_stack);
+
+    BvhAabb aabb = get_rect_aabb(rect);
+    int n_stack = 0;
+    int n_ids = 0;
+
+    stack[n_stack++] = bvh->root;
+    while (n_stack > 0) {
+        BvhNode *node = &bvh->nodes[stack[--n_stack]];
+        if (!is_aabb_overlap(node->aabb, aabb)) continue;
+
+        if (is_leaf(node)) {
+            if (n_ids == max_n_ids) break;
+            out_ids[n_ids++] = node->id;
+        } else {
+            stack[n_stack++] = node->left;
+            stack[n_stack++] = node->right;
+        }
+    }
+
+    if (stack != local_stack) free(stack);
+    return n_ids;
+}
+
+void raycast_bvh(Bvh *bvh, Vector2 start, Vector2 end, BvhRaycastFn fn, void *user) {
+    if (bvh->root == BVH_NULL_NODE) return;
+
+    int local_stack[BVH_STACK_SIZE];
+    int *stack = get_query_stack(bvh, local_stack);
+
+    float max_fraction = 1.0;
+    int n_stack = 0;
+
+    stack[n_stack++] = bvh->root;
+    while (n_stack > 0) {
+        BvhNode *node = &bvh->nodes[stack[--n_stack]];
+
+        float fraction;
+        if (!raycast_aabb(node->aabb, start, end, max_fraction, &fraction)) continue;
+
+        if (is_leaf(node)) {
+            max_fraction = fn(user, node->id, max_fraction);
+            if (max_fraction <= 0.0) break;
+        } else {
+            stack[n_stack++] = node->left;
+            stack[n_stack++] = node->right;
+        }
+    }
+
+    if (stack != local_stack) free(stack);
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "raylib.h"
+
+// -----------------------------------------------------------------------
+// dynamic AABB tree
+// leaves are rects identified by a caller-owned id (index into the
+// caller's array); leaves store fat AABBs, so an item moving within its fat
+// box costs nothing, and the tree is kept balanced with rotations on every
+// insert and remove
+
+#define BVH_NULL_NODE -1
+
+// world units added to each side of a leaf AABB
+#define BVH_FAT_MARGIN 1.0
+
+typedef struct BvhAabb {
+    float min_x;
+    float min_y;
+    float max_x;
+    float max_y;
+} BvhAabb;
+
+typedef struct BvhNode {
+    BvhAabb aabb;
+
+    // parent for nodes in the tree, next free node for free nodes
+    int parent;
+    int left;
+    int right;
+
+    // leaf: 0, free node: -1
+    int height;
+
+    // item id for leaves
+    int id;
+} BvhNode;
+
+typedef struct Bvh {
+    int root;
+
+    int n_nodes;
+    int capacity;
+    BvhNode *nodes;
+    int free_node;
+
+    // leaf node by item id, BVH_NULL_NODE if the item is not in the tree
+    int n_ids;
+    int *leaves;
+} Bvh;
+
+// called for every leaf the ray hits with the fraction of the ray
+// clipped so far; returns the new clip fraction (the hit fraction to find
+// the closest hit, max_fraction to skip the item, 0 to stop)
+typedef float (*BvhRaycastFn)(void *user, int id, float max_fraction);
+
+void reset_bvh(Bvh *bvh);
+void free_bvh(Bvh *bvh);
+
+void insert_bvh_item(Bvh *bvh, int id, Rectangle rect);
+void insert_bvh_items(
+    Bvh *bvh,
+    int first_id,
+    int n,
+    const float *x,
+    const float *y,
+    const float *width,
+    const float *height
+);
+bool update_bvh_item(Bvh *bvh, int id, Rectangle rect);
+void remove_bvh_item(Bvh *bvh, int id);
+
+int query_bvh(Bvh *bvh, Rectangle rect, int *out_ids, int max_n_ids);
+void raycast_bvh(Bvh *bvh, Vector2 start, Vector2 end, BvhRaycastFn fn, void *user);
+
+BvhAabb get_rect_aabb(Rectangle rect);
+bool is_aabb_overlap(BvhAabb a, BvhAabb b);
+bool raycast_aabb(
+    BvhAabb aabb, Vector2 start, Vector2 end, float max_fraction, float *out_fraction
+);
@@ -0,0 +1,43 @@
+#include "sim.h"
+#include <stdio.h>
+
+// -----------------------------------------------------------------------
+// level converter: reads a text level (see ./src/level.h) and writes it
+// as a binary level, with the static obstacles laid out in the order of
+// their static tree
+
+// usage: platforms_convert IN.txt OUT.plvl
+int main(int argc, char **argv) {
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s IN.txt OUT.plvl\n", argv[0]);
+        return 1;
+    }
+    const char *in_path = argv[1];
+    const char *out_path = argv[2];
+
+    // the platforms are spawned at world time 0, with no broadphase to
+    // keep up to date
+    init_kernels();
+    BROADPHASE = BROADPHASE_LINEAR;
+    reset_obstacles();
+
+    Vector2 spawn_position;
+    int line;
+    if (!load_level_text(in_path, &spawn_position, &line)) {
+        if (line == 0) fprintf(stderr, "can't read %s\n", in_path);
+        else fprintf(stderr, "%s:%d: unknown item or missing values\n", in_path, line);
+        return 1;
+    }
+    if (!save_level(out_path, spawn_position)) {
+        fprintf(stderr, "can't write %s\n", out_path);
+        return 1;
+    }
+
+    printf(
+        "%s: %d static obstacles, %d platforms\n",
+        out_path,
+        STATIC_OBSTACLES.n,
+        OBSTACLES.n
+    );
+    return 0;
+}
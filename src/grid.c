@@ -0,0 +1,169 @@
+#include "grid.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// -----------------------------------------------------------------------
+// cells
+static uint32_t get_bucket_idx(int x, int y) {
+    uint32_t h = (uint32_t)x * 73856093u ^ (uint32_t)y * 19349663u;
+    return h & (GRID_N_BUCKETS - 1);
+}
+
+static GridItem get_rect_cells(Grid *grid, Rectangle rect) {
+    return (GridItem){
+        .min_x = (int)floorf(rect.x / grid->cell_size),
+        .min_y = (int)floorf(rect.y / grid->cell_size),
+        .max_x = (int)floorf((rect.x + rect.width) / grid->cell_size),
+        .max_y = (int)floorf((rect.y + rect.height) / grid->cell_size),
+        .is_inserted = true,
+    };
+}
+
+static bool is_same_cells(GridItem a, GridItem b) {
+    return a.min_x == b.min_x && a.min_y == b.min_y && a.max_x == b.max_x
+           && a.max_y == b.max_y;
+}
+
+static void push_bucket_id(GridBucket *bucket, int id) {
+    if (bucket->n == bucket->capacity) {
+        bucket->capacity = bucket->capacity ? 2 * bucket->capacity : 8;
+        bucket->ids = realloc(bucket->ids, bucket->capacity * sizeof(int));
+    }
+    bucket->ids[bucket->n++] = id;
+}
+
+// an item spanning several cells that hash into one bucket is stored there
+// several times, so only one entry is removed per call
+static void remove_bucket_id(GridBucket *bucket, int id) {
+    for (int i = 0; i < bucket->n; ++i) {
+        if (bucket->ids[i] != id) continue;
+        bucket->ids[i] = bucket->ids[--bucket->n];
+        return;
+    }
+}
+
+static void insert_cells(Grid *grid, int id, GridItem cells) {
+    for (int y = cells.min_y; y <= cells.max_y; ++y) {
+        for (int x = cells.min_x; x <= cells.max_x; ++x) {
+            push_bucket_id(&grid->buckets[get_bucket_idx(x, y)], id);
+        }
+    }
+}
+
+static void remove_cells(Grid *grid, int id, GridItem cells) {
+    for (int y = cells.min_y; y <= cells.max_y; ++y) {
+        for (int x = cells.min_x; x <= cells.max_x; ++x) {
+            remove_bucket_id(&grid->buckets[get_bucket_idx(x, y)], id);
+        }
+    }
+}
+
+// -----------------------------------------------------------------------
+// grid
+void reset_grid(Grid *grid, float cell_size) {
+    for (int i = 0; i < GRID_N_BUCKETS; ++i) {
+        grid->buckets[i].n = 0;
+    }
+    if (grid->items) memset(grid->items, 0, grid->n_items * sizeof(GridItem));
+    grid->cell_size = cell_size;
+}
+
+void free_grid(Grid *grid) {
+    for (int i = 0; i < GRID_N_BUCKETS; ++i) {
+        free(grid->buckets[i].ids);
+    }
+    free(grid->items);
+    *grid = (Grid){0};
+}
+
+static void reserve_grid_items(Grid *grid, int n_items) {
+    if (n_items <= grid->n_items) return;
+
+    int n = grid->n_items ? grid->n_items : 64;
+    while (n < n_items) n *= 2;
+
+    grid->items = realloc(grid->items, n * sizeof(GridItem));
+    memset(grid->items + grid->n_items, 0, (n - grid->n_items) * sizeof(GridItem));
+    grid->n_items = n;
+}
+
+void insert_grid_item(Grid *grid, int id, Rectangle rect) {
+    reserve_grid_items(grid, id + 1);
+
+    GridItem *item = &grid->items[id];
+    if (item->is_inserted) remove_cells(grid, id, *item);
+
+    *item = get_rect_cells(grid, rect);
+    insert_cells(grid, id, *item);
+}
+
+// cheap when the rect stays within the same cells, which is the common
+// case for slowly moving platforms
+void update_grid_item(Grid *grid, int id, Rectangle rect) {
+    GridItem *item = &grid->items[id];
+    GridItem cells = get_rect_cells(grid, rect);
+    if (is_same_cells(*item, cells)) return;
+
+    remove_cells(grid, id, *item);
+    *item = cells;
+    insert_cells(grid, id, *item);
+}
+
+void remove_grid_item(Grid *grid, int id) {
+    if (id >= grid->n_items) return;
+
+    GridItem *item = &grid->items[id];
+    if (!item->is_inserted) return;
+
+    remove_cells(grid, id, *item);
+    item->is_inserted = false;
+}
+
+static int compare_ids(const void *a, const void *b) {
+    return *(const int *)a - *(const int *)b;
+}
+
+// sorts the ids and drops the repeated ones, returns the unique count
+static int unique_ids(int *ids, int n_ids) {
+    if (n_ids == 0) return 0;
+
+    qsort(ids, n_ids, sizeof(int), compare_ids);
+    int n = 1;
+    for (int i = 1; i < n_ids; ++i) {
+        if (ids[i] != ids[n - 1]) ids[n++] = ids[i];
+    }
+    return n;
+}
+
+// read-only, so queries can run from several threads at once
+// an item is found once per covered cell and once per bucket entry (cells
+// of one item can hash into the same bucket), so the ids are deduplicated
+// by a sort, and also whenever out_ids fills up, before giving up on the
+// remaining ones
+int query_grid(Grid *grid, Rectangle rect, int *out_ids, int max_n_ids) {
+    int n_ids = 0;
+    GridItem cells = get_rect_cells(grid, rect);
+    for (int y = cells.min_y; y <= cells.max_y; ++y) {
+        for (int x = cells.min_x; x <= cells.max_x; ++x) {
+            GridBucket *bucket = &grid->buckets[get_bucket_idx(x, y)];
+            for (int i = 0; i < bucket->n; ++i) {
+                int id = bucket->ids[i];
+                GridItem *item = &grid->items[id];
+
+                // skips the items hashed into this bucket from another cell
+                if (item->min_x > x || item->max_x < x) continue;
+                if (item->min_y > y || item->max_y < y) continue;
+                if (n_ids == max_n_ids) {
+                    n_ids = unique_ids(out_ids, n_ids);
+                    if (n_ids == max_n_ids) return n_ids;
+                }
+
+                out_ids[n_ids++] = id;
+            }
+        }
+    }
+
+    return unique_ids(out_ids, n_ids);
+}
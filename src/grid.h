@@ -0,0 +1,50 @@
+#pragma once
+
+#include "raylib.h"
+#include <stdint.h>
+
+// -----------------------------------------------------------------------
+// uniform spatial hash grid
+// items are rects identified by a caller-owned id (index into the
+// caller's array); cells are hashed into a fixed bucket table, so the grid
+// is unbounded and sparse, hash collisions only cost extra candidates
+
+#define GRID_N_BUCKETS 65536
+#define DEFAULT_GRID_CELL_SIZE 16.0
+
+typedef struct GridBucket {
+    int n;
+    int capacity;
+    int *ids;
+} GridBucket;
+
+// inclusive range of the cells covered by an item
+typedef struct GridItem {
+    int min_x;
+    int min_y;
+    int max_x;
+    int max_y;
+    bool is_inserted;
+} GridItem;
+
+typedef struct Grid {
+    float cell_size;
+    GridBucket buckets[GRID_N_BUCKETS];
+
+    // indexed by item id
+    int n_items;
+    GridItem *items;
+} Grid;
+
+void reset_grid(Grid *grid, float cell_size);
+void free_grid(Grid *grid);
+
+void insert_grid_item(Grid *grid, int id, Rectangle rect);
+void update_grid_item(Grid *grid, int id, Rectangle rect);
+void remove_grid_item(Grid *grid, int id);
+
+// writes ids of the items whose cells overlap the rect cells (a superset
+// of the actually overlapping items) into out_ids, each id once and in
+// ascending order
+// returns the number of ids written (at most max_n_ids)
+int query_grid(Grid *grid, Rectangle rect, int *out_ids, int max_n_ids);
@@ -0,0 +1,260 @@
+#include "profiler.h"
+#include "sim.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// -----------------------------------------------------------------------
+// headless runner: steps the simulation as fast as the CPU allows with no
+// window, for soak tests and throughput measurements
+
+#define DEFAULT_N_TICKS 1000000
+#define DEFAULT_SEED 0
+#define DEFAULT_N_AGENTS 1
+// one worker per online cpu
+#define DEFAULT_N_THREADS 0
+
+typedef struct Bot {
+    uint64_t n_frames;
+    Rng rng;
+} Bot;
+
+// one bot per agent
+static Bot *BOTS;
+static int N_AGENTS = DEFAULT_N_AGENTS;
+static int N_THREADS = DEFAULT_N_THREADS;
+static uint64_t N_TICKS_TO_RUN = DEFAULT_N_TICKS;
+static uint64_t SEED = DEFAULT_SEED;
+static const char *RECORD_PATH = NULL;
+static const char *PLAY_PATH = NULL;
+// zone stats csv written at the end, and trace (PROFILE=1 builds only)
+static const char *PROFILE_PATH = NULL;
+static const char *TRACE_PATH = NULL;
+
+// of the first level, before the ticks
+static double LOAD_TIME = 0.0;
+
+// -----------------------------------------------------------------------
+// utils
+static double get_time(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// -----------------------------------------------------------------------
+// host
+// scripted input: runs left and right in turns and jumps from time to time
+uint32_t get_bot_input(void *user, int agent) {
+    Bot *bot = (Bot *)user + agent;
+    uint32_t input = 0;
+
+    uint64_t phase = bot->n_frames / 240;
+    input |= phase % 2 ? INPUT_LEFT : INPUT_RIGHT;
+    if (next_rng_u32(&bot->rng) % 50 == 0) input |= INPUT_JUMP;
+
+    bot->n_frames += 1;
+    return input;
+}
+
+// every frame is exactly one tick, so the world is stepped with no waiting
+float get_tick_frame_time(void *user) {
+    return get_tick_dt();
+}
+
+// -----------------------------------------------------------------------
+// profile
+#ifdef PROFILE
+void start_profiler(void) {
+    init_profiler();
+    PROFILE_THREAD_NAME("main");
+    if (TRACE_PATH && !start_trace(TRACE_PATH)) {
+        fprintf(stderr, "can't trace to %s\n", TRACE_PATH);
+    }
+}
+
+// after the pool is stopped, the trace frees the rings of its workers
+void stop_profiler(double elapsed) {
+    uint64_t n_dropped = stop_trace();
+    if (n_dropped > 0) {
+        printf("trace: %llu events dropped\n", (unsigned long long)n_dropped);
+    }
+    if (PROFILE_PATH == NULL) return;
+
+    FILE *file = fopen(PROFILE_PATH, "w");
+    bool is_written = file && write_profile_csv_header(file);
+    is_written = is_written && write_profile_csv(file, elapsed);
+    if (file) fclose(file);
+    if (!is_written) fprintf(stderr, "can't write %s\n", PROFILE_PATH);
+}
+#else
+void start_profiler(void) {
+    if (PROFILE_PATH || TRACE_PATH) fprintf(stderr, "built without PROFILE=1\n");
+}
+
+void stop_profiler(double elapsed) {}
+#endif
+
+// -----------------------------------------------------------------------
+// main
+// usage: platforms_headless [--ticks N] [--tick-rate R] [--seed S]
+//                           [--agents N] [--threads N (0 = one per cpu)]
+//                           [--broadphase linear|grid|bvh|sap]
+//                           [--isa scalar|sse4.1|avx2|avx512]
+//                           [--level FILE] [--tower-budget KIB]
+//                           [--record FILE | --play FILE]
+//                           [--profile FILE] [--trace FILE]
+// a playback runs the whole replay, --ticks, --seed, --agents, --level and
+// --tower-budget are taken from the recording
+void parse_args(int argc, char **argv) {
+    for (int i = 1; i < argc - 1; ++i) {
+        if (strcmp(argv[i], "--ticks") == 0) {
+            N_TICKS_TO_RUN = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--tick-rate") == 0) {
+            TICK_RATE = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0) {
+            SEED = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--agents") == 0) {
+            N_AGENTS = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--threads") == 0) {
+            N_THREADS = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--broadphase") == 0) {
+            const char *name = argv[++i];
+            for (int b = 0; b < N_BROADPHASES; ++b) {
+                if (strcmp(name, get_broadphase_name(b)) == 0) BROADPHASE = b;
+            }
+        } else if (strcmp(argv[i], "--isa") == 0) {
+            const char *name = argv[++i];
+            if (!select_kernels(name)) fprintf(stderr, "unsupported isa: %s\n", name);
+        } else if (strcmp(argv[i], "--level") == 0) {
+            LEVEL_PATH = argv[++i];
+        } else if (strcmp(argv[i], "--tower-budget") == 0) {
+            TOWER.memory_budget = strtoul(argv[++i], NULL, 10) << 10;
+        } else if (strcmp(argv[i], "--record") == 0) {
+            RECORD_PATH = argv[++i];
+        } else if (strcmp(argv[i], "--play") == 0) {
+            PLAY_PATH = argv[++i];
+        } else if (strcmp(argv[i], "--profile") == 0) {
+            PROFILE_PATH = argv[++i];
+        } else if (strcmp(argv[i], "--trace") == 0) {
+            TRACE_PATH = argv[++i];
+        }
+    }
+
+    if (TICK_RATE <= 0) TICK_RATE = DEFAULT_TICK_RATE;
+    if (N_AGENTS <= 0) N_AGENTS = DEFAULT_N_AGENTS;
+}
+
+// loads the level and spreads the extra bots along the ground
+// returns false if the level file can't be loaded
+bool load_level(void) {
+    bool is_loaded = load_game();
+    for (int i = 1; i < N_AGENTS; ++i) {
+        float x = -15.0 + 30.0 * i / N_AGENTS;
+        spawn_agent((Vector2){x, 0.0});
+    }
+    return is_loaded;
+}
+
+int main(int argc, char **argv) {
+    init_kernels();
+    parse_args(argc, argv);
+    init_job_pool(N_THREADS);
+    start_profiler();
+
+    // every bot draws from its own stream of the seed
+    BOTS = calloc(N_AGENTS, sizeof(Bot));
+    for (int i = 0; i < N_AGENTS; ++i) {
+        BOTS[i].rng = make_rng(SEED, RNG_STREAM_HOST + i);
+    }
+    SIM_HOST = (SimHost){
+        .user = BOTS,
+        .get_input = get_bot_input,
+        .get_frame_time = get_tick_frame_time,
+    };
+
+    // the playback loads the level with its first tick
+    if (PLAY_PATH) {
+        if (!start_playback(PLAY_PATH)) {
+            fprintf(stderr, "can't play %s\n", PLAY_PATH);
+            return 1;
+        }
+    } else {
+        if (RECORD_PATH && !start_recording(RECORD_PATH, SEED)) {
+            fprintf(stderr, "can't record to %s\n", RECORD_PATH);
+            return 1;
+        }
+        if (!RECORD_PATH) seed_random(SEED);
+
+        double load_start_time = get_time();
+        if (!load_level()) {
+            fprintf(stderr, "can't load %s\n", LEVEL_PATH);
+            return 1;
+        }
+        LOAD_TIME = get_time() - load_start_time;
+    }
+
+    uint64_t n_ticks = 0;
+    uint64_t n_loads = 1;
+    uint64_t n_respawns = 0;
+    double start_time = get_time();
+    while (PLAY_PATH ? !REPLAY.is_done : n_ticks < N_TICKS_TO_RUN) {
+        n_ticks += update_simulation();
+        if (PLAY_PATH) continue;
+
+        // soak: restart the level whenever the first bot dies, the others
+        // are respawned in place
+        if (AGENTS.health[0] <= 0.0) {
+            load_level();
+            n_loads += 1;
+        }
+        for (int i = 1; i < AGENTS.n; ++i) {
+            if (AGENTS.health[i] > 0.0) continue;
+            respawn_agent(i);
+            n_respawns += 1;
+        }
+    }
+    double elapsed = get_time() - start_time;
+    bool is_playback = REPLAY.mode == REPLAY_PLAYING;
+    uint64_t diverged_tick = REPLAY.diverged_tick;
+    stop_replay();
+    free_tower();
+
+    printf("broadphase: %s\n", get_broadphase_name(BROADPHASE));
+    printf("isa: %s\n", KERNELS->name);
+    printf("threads: %d\n", get_n_job_workers());
+    printf("agents: %d\n", AGENTS.n);
+    printf("ticks: %llu\n", (unsigned long long)n_ticks);
+    if (!is_playback) {
+        printf("loads: %llu\n", (unsigned long long)n_loads);
+        printf("respawns: %llu\n", (unsigned long long)n_respawns);
+    } else if (diverged_tick) {
+        printf("replay: diverged at tick %llu\n", (unsigned long long)diverged_tick);
+    } else {
+        printf("replay: matched\n");
+    }
+    printf(
+        "tower chunks: %llu streamed (%llu prefetched), %llu evicted, %d max resident\n",
+        (unsigned long long)TOWER.n_streamed,
+        (unsigned long long)TOWER.n_prefetched,
+        (unsigned long long)TOWER.n_evicted,
+        TOWER.max_n_resident
+    );
+    printf("load: %.3f ms\n", 1e3 * LOAD_TIME);
+    printf("elapsed: %.3f s\n", elapsed);
+    printf("ticks/sec: %.0f\n", n_ticks / elapsed);
+    printf("agent ticks/sec: %.0f\n", n_ticks * (double)AGENTS.n / elapsed);
+    if (AGENTS.n > 0) {
+        printf(
+            "agent 0: position=(%.3f, %.3f) health=%.3f\n",
+            AGENTS.x[0],
+            AGENTS.y[0],
+            AGENTS.health[0]
+        );
+    }
+    free_job_pool();
+    stop_profiler(elapsed);
+
+    return is_playback && diverged_tick ? 2 : 0;
+}
@@ -0,0 +1,199 @@
+#include "jobs.h"
+
+#include "profiler.h"
+#include <sched.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+JobPool JOB_POOL = {
+    .n_workers = 1,
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .wake_cond = PTHREAD_COND_INITIALIZER,
+};
+
+// worker running a chunk on this thread, -1 outside of chunks
+// loops started from a chunk run inline as the same worker
+static _Thread_local int JOB_WORKER = -1;
+
+// -----------------------------------------------------------------------
+// chunk queues
+static uint64_t pack_chunks(uint32_t begin, uint32_t end) {
+    return (uint64_t)begin << 32 | end;
+}
+
+// the owner takes from the front
+static int pop_chunk(JobQueue *queue) {
+    uint64_t chunks = atomic_load(&queue->chunks);
+    for (;;) {
+        uint32_t begin = chunks >> 32;
+        uint32_t end = (uint32_t)chunks;
+        if (begin >= end) return -1;
+
+        uint64_t rest = pack_chunks(begin + 1, end);
+        if (atomic_compare_exchange_weak(&queue->chunks, &chunks, rest)) return begin;
+    }
+}
+
+// thieves take from the back, so they rarely contend with the owner
+static int steal_chunk(JobQueue *queue) {
+    uint64_t chunks = atomic_load(&queue->chunks);
+    for (;;) {
+        uint32_t begin = chunks >> 32;
+        uint32_t end = (uint32_t)chunks;
+        if (begin >= end) return -1;
+
+        uint64_t rest = pack_chunks(begin, end - 1);
+        if (atomic_compare_exchange_weak(&queue->chunks, &chunks, rest)) return end - 1;
+    }
+}
+
+static int take_chunk(JobPool *pool, int worker) {
+    int chunk = pop_chunk(&pool->queues[worker]);
+    for (int i = 1; chunk == -1 && i < pool->n_workers; ++i) {
+        chunk = steal_chunk(&pool->queues[(worker + i) % pool->n_workers]);
+    }
+    return chunk;
+}
+
+// runs chunks until every queue is empty
+static void run_chunks(JobPool *pool, int worker, JobFn fn, void *user) {
+    int chunk;
+    while ((chunk = take_chunk(pool, worker)) != -1) {
+        int begin = chunk * pool->chunk_size;
+        int end = begin + pool->chunk_size;
+        JOB_WORKER = worker;
+        fn(user, worker, begin, end < pool->n ? end : pool->n);
+        JOB_WORKER = -1;
+        atomic_fetch_sub(&pool->n_pending_chunks, 1);
+    }
+}
+
+// -----------------------------------------------------------------------
+// workers
+typedef struct WorkerArgs {
+    JobPool *pool;
+    int worker;
+} WorkerArgs;
+
+static void *run_worker(void *args_ptr) {
+    WorkerArgs args = *(WorkerArgs *)args_ptr;
+    free(args_ptr);
+
+    JobPool *pool = args.pool;
+    uint64_t generation = 0;
+    PROFILE_THREAD_NAME("job_worker");
+    for (;;) {
+        pthread_mutex_lock(&pool->mutex);
+        while (pool->generation == generation && !pool->is_stopping) {
+            pthread_cond_wait(&pool->wake_cond, &pool->mutex);
+        }
+        if (pool->is_stopping) {
+            pthread_mutex_unlock(&pool->mutex);
+            return NULL;
+        }
+        generation = pool->generation;
+        JobFn fn = pool->fn;
+        void *user = pool->user;
+        int profile_zone = pool->profile_zone;
+        atomic_fetch_add(&pool->n_busy_workers, 1);
+        pthread_mutex_unlock(&pool->mutex);
+
+        PROFILE_SET_ZONE(profile_zone);
+        run_chunks(pool, args.worker, fn, user);
+        atomic_fetch_sub(&pool->n_busy_workers, 1);
+    }
+}
+
+void init_job_pool(int n_workers) {
+    free_job_pool();
+
+    if (n_workers <= 0) n_workers = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n_workers <= 0) n_workers = 1;
+
+    JobPool *pool = &JOB_POOL;
+    pool->n_workers = n_workers;
+    pool->queues = aligned_alloc(JOB_CACHE_LINE_SIZE, n_workers * sizeof(JobQueue));
+    for (int i = 0; i < n_workers; ++i) {
+        atomic_init(&pool->queues[i].chunks, 0);
+    }
+
+    pool->threads = malloc(n_workers * sizeof(pthread_t));
+    for (int i = 1; i < n_workers; ++i) {
+        WorkerArgs *args = malloc(sizeof(WorkerArgs));
+        *args = (WorkerArgs){.pool = pool, .worker = i};
+        pthread_create(&pool->threads[i], NULL, run_worker, args);
+    }
+}
+
+void free_job_pool(void) {
+    JobPool *pool = &JOB_POOL;
+    if (pool->threads == NULL) return;
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->is_stopping = true;
+    pthread_cond_broadcast(&pool->wake_cond);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for (int i = 1; i < pool->n_workers; ++i) {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    free(pool->threads);
+    free(pool->queues);
+    pool->threads = NULL;
+    pool->queues = NULL;
+    pool->n_workers = 1;
+    pool->is_stopping = false;
+}
+
+int get_n_job_workers(void) {
+    return JOB_POOL.n_workers;
+}
+
+// -----------------------------------------------------------------------
+// parallel for
+void run_parallel_for(int n, int chunk_size, JobFn fn, void *user) {
+    JobPool *pool = &JOB_POOL;
+    if (n <= 0) return;
+
+    int n_chunks = (n + chunk_size - 1) / chunk_size;
+    if (JOB_WORKER != -1) {
+        fn(user, JOB_WORKER, 0, n);
+        return;
+    }
+    if (pool->n_workers <= 1 || n_chunks <= 1) {
+        fn(user, 0, 0, n);
+        return;
+    }
+
+    // a worker still looking for chunks of the previous loop would run
+    // this loop's chunks with the previous job, so wait it out; workers
+    // only become busy under the mutex
+    pthread_mutex_lock(&pool->mutex);
+    while (atomic_load(&pool->n_busy_workers) > 0) {
+        pthread_mutex_unlock(&pool->mutex);
+        sched_yield();
+        pthread_mutex_lock(&pool->mutex);
+    }
+
+    pool->fn = fn;
+    pool->user = user;
+    pool->n = n;
+    pool->chunk_size = chunk_size;
+    pool->profile_zone = PROFILE_GET_ZONE();
+    atomic_store(&pool->n_pending_chunks, n_chunks);
+    for (int i = 0; i < pool->n_workers; ++i) {
+        uint32_t begin = (int64_t)n_chunks * i / pool->n_workers;
+        uint32_t end = (int64_t)n_chunks * (i + 1) / pool->n_workers;
+        atomic_store(&pool->queues[i].chunks, pack_chunks(begin, end));
+    }
+
+    pool->generation += 1;
+    pthread_cond_broadcast(&pool->wake_cond);
+    pthread_mutex_unlock(&pool->mutex);
+
+    run_chunks(pool, 0, fn, user);
+    while (atomic_load(&pool->n_pending_chunks) > 0) {
+        sched_yield();
+    }
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// -----------------------------------------------------------------------
+// work-stealing job pool
+// runs parallel-for loops over index ranges split into chunks. every
+// worker starts with a contiguous run of chunks, takes them from the front
+// and, once it runs out, steals single chunks from the back of the others'
+// runs. the calling thread is worker 0 and takes part in every loop
+//
+// which worker runs a chunk is not deterministic, so the job must only
+// write per-index results or per-worker buffers that are merged in a fixed
+// order afterwards
+
+#define JOB_CACHE_LINE_SIZE 64
+
+// called for the indices from begin (inclusive) to end (exclusive)
+// worker is in [0, get_n_job_workers()), to index per-worker scratch
+typedef void (*JobFn)(void *user, int worker, int begin, int end);
+
+// chunks left to a worker, begin << 32 | end, padded to its own cache line
+typedef struct JobQueue {
+    _Alignas(JOB_CACHE_LINE_SIZE) _Atomic uint64_t chunks;
+} JobQueue;
+
+typedef struct JobPool {
+    int n_workers;
+    pthread_t *threads;
+    JobQueue *queues;
+
+    // workers sleep on wake_cond until the generation changes
+    pthread_mutex_t mutex;
+    pthread_cond_t wake_cond;
+    uint64_t generation;
+    bool is_stopping;
+
+    // current loop, written under the mutex before the generation changes
+    JobFn fn;
+    void *user;
+    int n;
+    int chunk_size;
+    // profiler zone of the caller, the chunks are timed under it
+    int profile_zone;
+
+    _Atomic int n_pending_chunks;
+    // workers between waking up for a loop and running out of chunks
+    _Atomic int n_busy_workers;
+} JobPool;
+
+extern JobPool JOB_POOL;
+
+// starts n_workers - 1 threads, 0 means one worker per online cpu
+// without a pool (or with one worker) the loops run inline
+void init_job_pool(int n_workers);
+void free_job_pool(void);
+
+int get_n_job_workers(void);
+
+// runs fn over [0, n) in chunks of chunk_size and returns when all of them
+// are done; called from within a chunk, it runs the whole range inline as
+// the chunk's worker
+void run_parallel_for(int n, int chunk_size, JobFn fn, void *user);
@@ -0,0 +1,61 @@
+#include "kernels.h"
+
+#include <string.h>
+
+// -----------------------------------------------------------------------
+// dispatch
+// the cpu is checked once at startup, the hot loops then call through
+// KERNELS with no per-call feature tests
+
+const Kernels *KERNELS = &KERNELS_SCALAR;
+
+#if defined(__x86_64__) || defined(__i386__)
+#define KERNELS_X86
+#endif
+
+static bool is_kernels_supported(const Kernels *kernels) {
+#if defined(KERNELS_X86)
+    __builtin_cpu_init();
+    if (kernels == &KERNELS_AVX512) return __builtin_cpu_supports("avx512f");
+    if (kernels == &KERNELS_AVX2) return __builtin_cpu_supports("avx2");
+    if (kernels == &KERNELS_SSE41) return __builtin_cpu_supports("sse4.1");
+#endif
+    return kernels == &KERNELS_SCALAR;
+}
+
+static const Kernels *get_kernels(int idx) {
+    static const Kernels *kernels[] = {
+#if defined(KERNELS_X86)
+        &KERNELS_AVX512,
+        &KERNELS_AVX2,
+        &KERNELS_SSE41,
+#endif
+        &KERNELS_SCALAR,
+    };
+    int n = sizeof(kernels) / sizeof(kernels[0]);
+    return idx < n ? kernels[idx] : NULL;
+}
+
+// picks the widest variant the cpu supports
+void init_kernels(void) {
+    const Kernels *kernels;
+    for (int i = 0; (kernels = get_kernels(i)); ++i) {
+        if (is_kernels_supported(kernels)) {
+            KERNELS = kernels;
+            return;
+        }
+    }
+}
+
+// forces a variant by name (e.g. "sse4.1"), for testing and benchmarking
+// returns false and keeps the current one if the cpu doesn't support it
+bool select_kernels(const char *name) {
+    const Kernels *kernels;
+    for (int i = 0; (kernels = get_kernels(i)); ++i) {
+        if (strcmp(kernels->name, name) == 0 && is_kernels_supported(kernels)) {
+            KERNELS = kernels;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "aabb.h"
+#include "raylib.h"
+#include "rng.h"
+#include <math.h>
+
+// -----------------------------------------------------------------------
+// hot loops built once per instruction set (scalar, SSE4.1, AVX2,
+// AVX-512) from src/kernels_isa.c; init_kernels picks the best variant the
+// CPU supports. every variant gives bit-identical results
+
+// min/max of the per-rect mtv components (zero included), the reduction
+// update_agent_collisions resolves an agent with
+typedef struct MtvBounds {
+    float min_x;
+    float max_x;
+    float min_y;
+    float max_y;
+    int n_overlaps;
+} MtvBounds;
+
+// distance from the path start of a platform ping-ponging along a path of
+// the length, at the time; phase is the distance travelled at time zero
+// the distance is reduced to one start -> end -> start cycle in double
+// precision, so the positions don't lose precision as the time grows
+static inline float get_path_offset(float length, double phase, float speed, double time) {
+    double period = 2.0 * length;
+    double distance = phase + speed * time;
+    double cycle = period > 0.0 ? distance - floor(distance / period) * period : 0.0;
+    return cycle < length ? cycle : period - cycle;
+}
+
+typedef struct Kernels {
+    const char *name;
+
+    // computes get_aabb_mtv(rect, {x[i], y[i], width[i], height[i]}) for
+    // n rects and writes the y components into out_mtv_y
+    MtvBounds (*get_aabb_mtv_batch)(
+        Rectangle rect,
+        const float *x,
+        const float *y,
+        const float *width,
+        const float *height,
+        int n,
+        float *out_mtv_y
+    );
+
+    // sets the platform positions at the world time to
+    // start + direction * get_path_offset(...), writes the position
+    // changes into out_step_x/y
+    void (*evaluate_platforms)(
+        const Vector2 *restrict start,
+        const Vector2 *restrict direction,
+        const float *restrict length,
+        const double *restrict phase,
+        const float *restrict speed,
+        int n,
+        double time,
+        float *restrict x,
+        float *restrict y,
+        float *restrict out_step_x,
+        float *restrict out_step_y
+    );
+
+    // out[i] = a[i] + t * (b[i] - a[i])
+    void (*lerp_floats)(const float *a, const float *b, float t, float *out, int n);
+
+    // writes n_blocks blocks of RNG_N_LANES floats, lane i of a block is
+    // get_rng_float(get_pcg32_output(lanes[i])), then every lane takes the
+    // lcg step state * multiplier + inc
+    void (*fill_rng_lanes)(
+        uint64_t *restrict lanes,
+        uint64_t multiplier,
+        uint64_t inc,
+        float *restrict out,
+        int n_blocks
+    );
+} Kernels;
+
+extern const Kernels KERNELS_SCALAR;
+extern const Kernels KERNELS_SSE41;
+extern const Kernels KERNELS_AVX2;
+extern const Kernels KERNELS_AVX512;
+
+// kernels in use, scalar until init_kernels
+extern const Kernels *KERNELS;
+
+void init_kernels(void);
+bool select_kernels(const char *name);
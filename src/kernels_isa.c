@@ -0,0 +1,282 @@
+#include "kernels.h"
+
+#include <math.h>
+
+// -----------------------------------------------------------------------
+// kernel variants
+// this file is compiled once per instruction set with one of the
+// KERNELS_ISA_* macros and the matching -m flags (see the Makefile), so
+// nothing here may run before init_kernels checked the cpu supports it
+// all variants are compiled with -ffp-contract=off and do the arithmetic of
+// the scalar code in the same order, so the results are bit-identical
+
+#if defined(KERNELS_ISA_AVX512)
+
+#include <immintrin.h>
+#define KERNELS_TABLE KERNELS_AVX512
+#define KERNELS_NAME "avx512"
+
+#define N_LANES 16
+typedef __m512 Lanes;
+typedef __mmask16 Mask;
+
+#define lanes_set1(a) _mm512_set1_ps(a)
+#define lanes_loadu(p) _mm512_loadu_ps(p)
+#define lanes_storeu(p, a) _mm512_storeu_ps(p, a)
+#define lanes_add(a, b) _mm512_add_ps(a, b)
+#define lanes_sub(a, b) _mm512_sub_ps(a, b)
+#define lanes_min(a, b) _mm512_min_ps(a, b)
+#define lanes_max(a, b) _mm512_max_ps(a, b)
+#define lanes_abs(a) _mm512_abs_ps(a)
+#define lanes_lt(a, b) _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ)
+#define lanes_select(mask, a, b) _mm512_mask_blend_ps(mask, b, a)
+#define lanes_keep(mask, a) _mm512_maskz_mov_ps(mask, a)
+#define mask_and(a, b) ((Mask)((a) & (b)))
+#define mask_not(a) ((Mask) ~(a))
+#define mask_count(a) __builtin_popcount(a)
+
+#elif defined(KERNELS_ISA_AVX2)
+
+#include <immintrin.h>
+#define KERNELS_TABLE KERNELS_AVX2
+#define KERNELS_NAME "avx2"
+
+#define N_LANES 8
+typedef __m256 Lanes;
+typedef __m256 Mask;
+
+#define lanes_set1(a) _mm256_set1_ps(a)
+#define lanes_loadu(p) _mm256_loadu_ps(p)
+#define lanes_storeu(p, a) _mm256_storeu_ps(p, a)
+#define lanes_add(a, b) _mm256_add_ps(a, b)
+#define lanes_sub(a, b) _mm256_sub_ps(a, b)
+#define lanes_min(a, b) _mm256_min_ps(a, b)
+#define lanes_max(a, b) _mm256_max_ps(a, b)
+#define lanes_abs(a) _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a)
+#define lanes_lt(a, b) _mm256_cmp_ps(a, b, _CMP_LT_OQ)
+#define lanes_select(mask, a, b) _mm256_blendv_ps(b, a, mask)
+#define lanes_keep(mask, a) _mm256_and_ps(mask, a)
+#define mask_and(a, b) _mm256_and_ps(a, b)
+#define mask_not(a) _mm256_xor_ps(a, _mm256_castsi256_ps(_mm256_set1_epi32(-1)))
+#define mask_count(a) __builtin_popcount(_mm256_movemask_ps(a))
+
+#elif defined(KERNELS_ISA_SSE41)
+
+#include <smmintrin.h>
+#define KERNELS_TABLE KERNELS_SSE41
+#define KERNELS_NAME "sse4.1"
+
+#define N_LANES 4
+typedef __m128 Lanes;
+typedef __m128 Mask;
+
+#define lanes_set1(a) _mm_set1_ps(a)
+#define lanes_loadu(p) _mm_loadu_ps(p)
+#define lanes_storeu(p, a) _mm_storeu_ps(p, a)
+#define lanes_add(a, b) _mm_add_ps(a, b)
+#define lanes_sub(a, b) _mm_sub_ps(a, b)
+#define lanes_min(a, b) _mm_min_ps(a, b)
+#define lanes_max(a, b) _mm_max_ps(a, b)
+#define lanes_abs(a) _mm_andnot_ps(_mm_set1_ps(-0.0f), a)
+#define lanes_lt(a, b) _mm_cmplt_ps(a, b)
+#define lanes_select(mask, a, b) _mm_blendv_ps(b, a, mask)
+#define lanes_keep(mask, a) _mm_and_ps(mask, a)
+#define mask_and(a, b) _mm_and_ps(a, b)
+#define mask_not(a) _mm_xor_ps(a, _mm_castsi128_ps(_mm_set1_epi32(-1)))
+#define mask_count(a) __builtin_popcount(_mm_movemask_ps(a))
+
+#elif defined(KERNELS_ISA_SCALAR)
+
+#define KERNELS_TABLE KERNELS_SCALAR
+#define KERNELS_NAME "scalar"
+
+#else
+#error "kernels_isa.c must be compiled with one of the KERNELS_ISA_* macros"
+#endif
+
+// -----------------------------------------------------------------------
+// mtv
+static void reduce_mtv(MtvBounds *bounds, Vector2 mtv) {
+    bounds->min_x = fminf(bounds->min_x, mtv.x);
+    bounds->max_x = fmaxf(bounds->max_x, mtv.x);
+    bounds->min_y = fminf(bounds->min_y, mtv.y);
+    bounds->max_y = fmaxf(bounds->max_y, mtv.y);
+}
+
+#if defined(N_LANES)
+
+// the branches of get_aabb_mtv become lane masks and selects
+// returns the number of rects processed, the tail is left to the scalar loop
+static int get_aabb_mtv_lanes(
+    Rectangle rect,
+    const float *x,
+    const float *y,
+    const float *width,
+    const float *height,
+    int n,
+    float *out_mtv_y,
+    MtvBounds *bounds
+) {
+    Lanes zero = lanes_set1(0.0f);
+    Lanes r_x = lanes_set1(rect.x);
+    Lanes r_y = lanes_set1(rect.y);
+    Lanes r_x_max = lanes_set1(rect.x + rect.width);
+    Lanes r_y_max = lanes_set1(rect.y + rect.height);
+    Lanes r_width = lanes_set1(rect.width);
+    Lanes r_height = lanes_set1(rect.height);
+
+    Lanes min_x = zero;
+    Lanes max_x = zero;
+    Lanes min_y = zero;
+    Lanes max_y = zero;
+
+    int i = 0;
+    for (; i + N_LANES <= n; i += N_LANES) {
+        Lanes o_x = lanes_loadu(x + i);
+        Lanes o_y = lanes_loadu(y + i);
+        Lanes o_x_max = lanes_add(o_x, lanes_loadu(width + i));
+        Lanes o_y_max = lanes_add(o_y, lanes_loadu(height + i));
+
+        Mask is_overlap_x = mask_and(lanes_lt(r_x, o_x_max), lanes_lt(o_x, r_x_max));
+        Mask is_overlap_y = mask_and(lanes_lt(r_y, o_y_max), lanes_lt(o_y, r_y_max));
+        Mask is_overlap = mask_and(is_overlap_x, is_overlap_y);
+        bounds->n_overlaps += mask_count(is_overlap);
+
+        Lanes x_west = lanes_sub(lanes_sub(o_x, r_x), r_width);
+        Lanes x_east = lanes_sub(o_x_max, r_x);
+        Mask is_west = lanes_lt(lanes_abs(x_west), lanes_abs(x_east));
+        Lanes mtv_x = lanes_select(is_west, x_west, x_east);
+
+        Lanes y_south = lanes_sub(o_y_max, r_y);
+        Lanes y_north = lanes_sub(lanes_sub(o_y, r_y), r_height);
+        Mask is_south = lanes_lt(lanes_abs(y_south), lanes_abs(y_north));
+        Lanes mtv_y = lanes_select(is_south, y_south, y_north);
+
+        // keep the axis of the smaller penetration
+        Mask is_y = lanes_lt(lanes_abs(mtv_y), lanes_abs(mtv_x));
+        mtv_x = lanes_keep(mask_and(mask_not(is_y), is_overlap), mtv_x);
+        mtv_y = lanes_keep(mask_and(is_y, is_overlap), mtv_y);
+
+        min_x = lanes_min(min_x, mtv_x);
+        max_x = lanes_max(max_x, mtv_x);
+        min_y = lanes_min(min_y, mtv_y);
+        max_y = lanes_max(max_y, mtv_y);
+        lanes_storeu(out_mtv_y + i, mtv_y);
+    }
+
+    float lanes[4][N_LANES];
+    lanes_storeu(lanes[0], min_x);
+    lanes_storeu(lanes[1], max_x);
+    lanes_storeu(lanes[2], min_y);
+    lanes_storeu(lanes[3], max_y);
+    for (int lane = 0; lane < N_LANES; ++lane) {
+        bounds->min_x = fminf(bounds->min_x, lanes[0][lane]);
+        bounds->max_x = fmaxf(bounds->max_x, lanes[1][lane]);
+        bounds->min_y = fminf(bounds->min_y, lanes[2][lane]);
+        bounds->max_y = fmaxf(bounds->max_y, lanes[3][lane]);
+    }
+
+    return i;
+}
+
+#endif
+
+static MtvBounds get_aabb_mtv_batch(
+    Rectangle rect,
+    const float *x,
+    const float *y,
+    const float *width,
+    const float *height,
+    int n,
+    float *out_mtv_y
+) {
+    MtvBounds bounds = {0};
+    int i = 0;
+
+#if defined(N_LANES)
+    i = get_aabb_mtv_lanes(rect, x, y, width, height, n, out_mtv_y, &bounds);
+#endif
+
+    for (; i < n; ++i) {
+        Rectangle other = {x[i], y[i], width[i], height[i]};
+        bounds.n_overlaps += check_collision_recs(rect, other);
+
+        Vector2 mtv = get_aabb_mtv(rect, other);
+        reduce_mtv(&bounds, mtv);
+        out_mtv_y[i] = mtv.y;
+    }
+
+    return bounds;
+}
+
+// -----------------------------------------------------------------------
+// platforms
+// branch-free so the compiler vectorizes it with the variant's -m flags
+static void evaluate_platforms(
+    const Vector2 *restrict start,
+    const Vector2 *restrict direction,
+    const float *restrict length,
+    const double *restrict phase,
+    const float *restrict speed,
+    int n,
+    double time,
+    float *restrict x,
+    float *restrict y,
+    float *restrict out_step_x,
+    float *restrict out_step_y
+) {
+    for (int i = 0; i < n; ++i) {
+        float offset = get_path_offset(length[i], phase[i], speed[i], time);
+        float position_x = start[i].x + direction[i].x * offset;
+        float position_y = start[i].y + direction[i].y * offset;
+
+        out_step_x[i] = position_x - x[i];
+        out_step_y[i] = position_y - y[i];
+        x[i] = position_x;
+        y[i] = position_y;
+    }
+}
+
+// -----------------------------------------------------------------------
+// vector2 bulk ops
+static void lerp_floats(const float *a, const float *b, float t, float *out, int n) {
+    for (int i = 0; i < n; ++i) {
+        out[i] = a[i] + t * (b[i] - a[i]);
+    }
+}
+
+// -----------------------------------------------------------------------
+// random
+// the lanes are independent, so the block loop vectorizes over them
+static void fill_rng_lanes(
+    uint64_t *restrict lanes,
+    uint64_t multiplier,
+    uint64_t inc,
+    float *restrict out,
+    int n_blocks
+) {
+    uint64_t states[RNG_N_LANES];
+    for (int i = 0; i < RNG_N_LANES; ++i) {
+        states[i] = lanes[i];
+    }
+
+    for (int block = 0; block < n_blocks; ++block) {
+        float *block_out = out + block * RNG_N_LANES;
+        for (int i = 0; i < RNG_N_LANES; ++i) {
+            block_out[i] = get_rng_float(get_pcg32_output(states[i]));
+            states[i] = states[i] * multiplier + inc;
+        }
+    }
+
+    for (int i = 0; i < RNG_N_LANES; ++i) {
+        lanes[i] = states[i];
+    }
+}
+
+const Kernels KERNELS_TABLE = {
+    .name = KERNELS_NAME,
+    .get_aabb_mtv_batch = get_aabb_mtv_batch,
+    .evaluate_platforms = evaluate_platforms,
+    .lerp_floats = lerp_floats,
+    .fill_rng_lanes = fill_rng_lanes,
+};
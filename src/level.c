@@ -0,0 +1,313 @@
+#include "level.h"
+
+#include "sim.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedLevel MAPPED_LEVEL = {0};
+
+static const size_t LEVEL_SECTION_SIZES[N_LEVEL_SECTIONS] = {
+    [LEVEL_STATIC_X] = sizeof(float),
+    [LEVEL_STATIC_Y] = sizeof(float),
+    [LEVEL_STATIC_WIDTH] = sizeof(float),
+    [LEVEL_STATIC_HEIGHT] = sizeof(float),
+    [LEVEL_STATIC_BVH_NODES] = sizeof(StaticBvhNode),
+    [LEVEL_PLATFORM_WIDTH] = sizeof(float),
+    [LEVEL_PLATFORM_HEIGHT] = sizeof(float),
+    [LEVEL_PLATFORM_START] = sizeof(Vector2),
+    [LEVEL_PLATFORM_DIRECTION] = sizeof(Vector2),
+    [LEVEL_PLATFORM_LENGTH] = sizeof(float),
+    [LEVEL_PLATFORM_PHASE] = sizeof(double),
+    [LEVEL_PLATFORM_SPEED] = sizeof(float),
+};
+
+static int get_level_section_count(const LevelHeader *header, LevelSection section) {
+    if (section < LEVEL_STATIC_BVH_NODES) return header->n_static_obstacles;
+    if (section == LEVEL_STATIC_BVH_NODES) return header->n_static_bvh_nodes;
+    return header->n_platforms;
+}
+
+static uint64_t align_level_offset(uint64_t offset) {
+    return (offset + LEVEL_ALIGNMENT - 1) / LEVEL_ALIGNMENT * LEVEL_ALIGNMENT;
+}
+
+// -----------------------------------------------------------------------
+// mapping
+// the tree is walked by index, so its links must stay in range; nodes are
+// stored depth-first, so inner nodes only link forward and the walk always
+// ends, and the depth must fit the query stack
+static bool is_static_bvh_valid(const StaticBvhNode *nodes, int n_nodes, int n_items) {
+    // children come after their parent, so one pass finds every depth
+    int *depths = calloc(n_nodes, sizeof(int));
+    bool is_valid = true;
+    for (int i = 0; i < n_nodes; ++i) {
+        const StaticBvhNode *node = &nodes[i];
+        if (node->n_items > 0) {
+            is_valid = node->n_items <= STATIC_BVH_MAX_LEAF_SIZE && node->first >= 0
+                       && node->first <= n_items - node->n_items;
+        } else {
+            is_valid = node->n_items == 0 && i + 1 < n_nodes && node->first > i + 1
+                       && node->first < n_nodes && depths[i] < STATIC_BVH_MAX_DEPTH;
+        }
+        if (!is_valid) break;
+        if (node->n_items > 0) continue;
+
+        int depth = depths[i] + 1;
+        if (depth > depths[i + 1]) depths[i + 1] = depth;
+        if (depth > depths[node->first]) depths[node->first] = depth;
+    }
+
+    free(depths);
+    return is_valid;
+}
+
+// the sections must fit the file
+static bool is_level_valid(const LevelHeader *header, size_t size) {
+    if (size < sizeof(LevelHeader)) return false;
+    if (header->magic != LEVEL_MAGIC || header->version != LEVEL_VERSION) return false;
+    if (header->size != size) return false;
+
+    int n_static_obstacles = header->n_static_obstacles;
+    int n_nodes = header->n_static_bvh_nodes;
+    if (n_static_obstacles < 0 || n_nodes < 0 || header->n_platforms < 0) return false;
+    if ((n_static_obstacles > 0) != (n_nodes > 0)) return false;
+    if (n_nodes > 0 && n_nodes > 2 * (int64_t)n_static_obstacles - 1) return false;
+
+    for (int i = 0; i < N_LEVEL_SECTIONS; ++i) {
+        uint64_t offset = header->section_offsets[i];
+        uint64_t n_bytes = get_level_section_count(header, i) * LEVEL_SECTION_SIZES[i];
+        if (offset % LEVEL_ALIGNMENT != 0 || offset < sizeof(LevelHeader)) return false;
+        if (offset > size || n_bytes > size - offset) return false;
+    }
+
+    const StaticBvhNode *nodes = get_level_section(header, LEVEL_STATIC_BVH_NODES);
+    return is_static_bvh_valid(nodes, n_nodes, n_static_obstacles);
+}
+
+const LevelHeader *map_level(const char *path, MappedLevel *out_level) {
+    *out_level = (MappedLevel){0};
+
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) return NULL;
+
+    struct stat st;
+    void *data = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (data == MAP_FAILED) return NULL;
+
+    if (!is_level_valid(data, st.st_size)) {
+        munmap(data, st.st_size);
+        return NULL;
+    }
+
+    // the collision pass will touch all of it soon
+    madvise(data, st.st_size, MADV_WILLNEED);
+    *out_level = (MappedLevel){.data = data, .size = st.st_size};
+    return data;
+}
+
+void unmap_level(MappedLevel *level) {
+    if (level->data == NULL) return;
+    munmap(level->data, level->size);
+    *level = (MappedLevel){0};
+}
+
+const void *get_level_section(const LevelHeader *header, LevelSection section) {
+    return (const char *)header + header->section_offsets[section];
+}
+
+// -----------------------------------------------------------------------
+// text
+bool load_level_text(const char *path, Vector2 *out_spawn_position, int *out_line) {
+    *out_spawn_position = (Vector2){0.0, 0.0};
+    *out_line = 0;
+
+    FILE *file = fopen(path, "r");
+    if (file == NULL) return false;
+
+    char line[256];
+    bool is_read = true;
+    while (is_read && fgets(line, sizeof(line), file)) {
+        *out_line += 1;
+        char *comment = strchr(line, '#');
+        if (comment) *comment = '\0';
+
+        char kind[16];
+        int n_chars;
+        if (sscanf(line, "%15s%n", kind, &n_chars) != 1) continue;
+        const char *args = line + n_chars;
+
+        float v[9];
+        if (strcmp(kind, "spawn") == 0) {
+            is_read = sscanf(args, "%f %f", &v[0], &v[1]) == 2;
+            if (is_read) *out_spawn_position = (Vector2){v[0], v[1]};
+        } else if (strcmp(kind, "static") == 0) {
+            is_read = sscanf(args, "%f %f %f %f", &v[0], &v[1], &v[2], &v[3]) == 4;
+            if (is_read) spawn_static_obstacle((Rectangle){v[0], v[1], v[2], v[3]});
+        } else if (strcmp(kind, "platform") == 0) {
+            int n_read = sscanf(
+                args,
+                "%f %f %f %f %f %f %f %f %f",
+                &v[0],
+                &v[1],
+                &v[2],
+                &v[3],
+                &v[4],
+                &v[5],
+                &v[6],
+                &v[7],
+                &v[8]
+            );
+            is_read = n_read == 9;
+            if (is_read) {
+                Rectangle rect = {v[0], v[1], v[2], v[3]};
+                spawn_obstacle(rect, (Vector2){v[4], v[5]}, (Vector2){v[6], v[7]}, v[8]);
+            }
+        } else {
+            is_read = false;
+        }
+    }
+    fclose(file);
+
+    return is_read;
+}
+
+// -----------------------------------------------------------------------
+// binary
+static bool write_level_padding(FILE *file, uint64_t offset) {
+    static const char zeros[LEVEL_ALIGNMENT] = {0};
+    long position = ftell(file);
+    while (position >= 0 && (uint64_t)position < offset) {
+        size_t n = offset - position < LEVEL_ALIGNMENT ? offset - position
+                                                        : LEVEL_ALIGNMENT;
+        if (fwrite(zeros, 1, n, file) != n) return false;
+        position += n;
+    }
+    return position >= 0;
+}
+
+// the pool positions aren't stored, the loader evaluates the paths
+bool save_level(const char *path, Vector2 spawn_position) {
+    build_static_obstacles();
+
+    const void *sections[N_LEVEL_SECTIONS] = {
+        [LEVEL_STATIC_X] = STATIC_OBSTACLES.x,
+        [LEVEL_STATIC_Y] = STATIC_OBSTACLES.y,
+        [LEVEL_STATIC_WIDTH] = STATIC_OBSTACLES.width,
+        [LEVEL_STATIC_HEIGHT] = STATIC_OBSTACLES.height,
+        [LEVEL_STATIC_BVH_NODES] = STATIC_OBSTACLES_BVH.nodes,
+        [LEVEL_PLATFORM_WIDTH] = OBSTACLES.width,
+        [LEVEL_PLATFORM_HEIGHT] = OBSTACLES.height,
+        [LEVEL_PLATFORM_START] = OBSTACLES.start,
+        [LEVEL_PLATFORM_DIRECTION] = OBSTACLES.direction,
+        [LEVEL_PLATFORM_LENGTH] = OBSTACLES.length,
+        [LEVEL_PLATFORM_PHASE] = OBSTACLES.phase,
+        [LEVEL_PLATFORM_SPEED] = OBSTACLES.speed,
+    };
+
+    LevelHeader header = {
+        .magic = LEVEL_MAGIC,
+        .version = LEVEL_VERSION,
+        .spawn_position = spawn_position,
+        .n_static_obstacles = STATIC_OBSTACLES.n,
+        .n_static_bvh_nodes = STATIC_OBSTACLES_BVH.n_nodes,
+        .n_platforms = OBSTACLES.n,
+    };
+    uint64_t offset = align_level_offset(sizeof(LevelHeader));
+    for (int i = 0; i < N_LEVEL_SECTIONS; ++i) {
+        header.section_offsets[i] = offset;
+        uint64_t n_bytes = get_level_section_count(&header, i) * LEVEL_SECTION_SIZES[i];
+        offset = align_level_offset(offset + n_bytes);
+    }
+    header.size = offset;
+
+    // the same inode rewritten in place would change (or cut short) the
+    // pages of the games mapping it
+    size_t path_length = strlen(path);
+    char *tmp_path = malloc(path_length + sizeof(".tmp"));
+    memcpy(tmp_path, path, path_length);
+    memcpy(tmp_path + path_length, ".tmp", sizeof(".tmp"));
+
+    FILE *file = fopen(tmp_path, "wb");
+    if (file == NULL) {
+        free(tmp_path);
+        return false;
+    }
+
+    bool is_written = fwrite(&header, sizeof(header), 1, file) == 1;
+    for (int i = 0; i < N_LEVEL_SECTIONS && is_written; ++i) {
+        size_t n_bytes = get_level_section_count(&header, i) * LEVEL_SECTION_SIZES[i];
+        is_written = write_level_padding(file, header.section_offsets[i]);
+        if (is_written && n_bytes > 0) {
+            is_written = fwrite(sections[i], 1, n_bytes, file) == n_bytes;
+        }
+    }
+    is_written = is_written && write_level_padding(file, header.size);
+    is_written = fclose(file) == 0 && is_written;
+    is_written = is_written && rename(tmp_path, path) == 0;
+    if (!is_written) remove(tmp_path);
+    free(tmp_path);
+
+    return is_written;
+}
+
+// -----------------------------------------------------------------------
+// watch
+bool watch_level(LevelWatch *watch, const char *path) {
+    *watch = (LevelWatch){.fd = -1};
+
+    const char *slash = strrchr(path, '/');
+    const char *name = slash ? slash + 1 : path;
+    if (strlen(name) >= sizeof(watch->name)) return false;
+    strcpy(watch->name, name);
+
+    // the root keeps its slash
+    char dir[4096] = ".";
+    if (slash) {
+        size_t dir_length = slash == path ? 1 : slash - path;
+        if (dir_length >= sizeof(dir)) return false;
+        memcpy(dir, path, dir_length);
+        dir[dir_length] = '\0';
+    }
+
+    watch->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watch->fd == -1) return false;
+    if (inotify_add_watch(watch->fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO) == -1) {
+        unwatch_level(watch);
+        return false;
+    }
+    return true;
+}
+
+bool poll_level_watch(LevelWatch *watch) {
+    if (watch->fd == -1) return false;
+
+    // a write burst (or an editor saving twice) is read as one change
+    char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    bool is_changed = false;
+    ssize_t n_bytes;
+    while ((n_bytes = read(watch->fd, events, sizeof(events))) > 0) {
+        for (char *p = events; p < events + n_bytes;) {
+            const struct inotify_event *event = (const struct inotify_event *)p;
+            if (event->len > 0 && strcmp(event->name, watch->name) == 0) {
+                is_changed = true;
+            }
+            p += sizeof(struct inotify_event) + event->len;
+        }
+    }
+    return is_changed;
+}
+
+void unwatch_level(LevelWatch *watch) {
+    if (watch->fd != -1) close(watch->fd);
+    watch->fd = -1;
+}
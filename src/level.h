@@ -0,0 +1,109 @@
+#pragma once
+
+#include "raylib.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// -----------------------------------------------------------------------
+// level files
+// a binary level is mapped read-only and used in place, with no parse
+// step: the static obstacles are stored as the StaticObstacles arrays,
+// already laid out in the order of their static tree, and the tree nodes
+// are stored too, so the static set and its index point into the file.
+// the platforms are stored as the Obstacles path arrays and copied into
+// the pool in bulk, since the pool moves them every tick
+//
+// file layout, in the byte order of the machine that wrote it (the magic
+// doesn't match on the other one): a LevelHeader, then the sections at
+// LEVEL_ALIGNMENT aligned offsets given by the header
+//
+// a running level can be patched from its file again (see reload_level),
+// LevelWatch tells when the file changed
+//
+// levels are written by platforms_convert from a text format, one item per
+// line, # starts a comment:
+//   spawn X Y
+//   static X Y WIDTH HEIGHT
+//   platform X Y WIDTH HEIGHT START_X START_Y END_X END_Y SPEED
+// the platforms start from X Y projected on their path, moving to the end
+
+#define LEVEL_MAGIC 0x4c564c50u
+#define LEVEL_VERSION 1
+#define LEVEL_ALIGNMENT 64
+
+typedef enum LevelSection {
+    // float per static obstacle
+    LEVEL_STATIC_X,
+    LEVEL_STATIC_Y,
+    LEVEL_STATIC_WIDTH,
+    LEVEL_STATIC_HEIGHT,
+    // StaticBvhNode per node
+    LEVEL_STATIC_BVH_NODES,
+    // per platform: float, float, Vector2, Vector2, float, double, float
+    LEVEL_PLATFORM_WIDTH,
+    LEVEL_PLATFORM_HEIGHT,
+    LEVEL_PLATFORM_START,
+    LEVEL_PLATFORM_DIRECTION,
+    LEVEL_PLATFORM_LENGTH,
+    LEVEL_PLATFORM_PHASE,
+    LEVEL_PLATFORM_SPEED,
+    N_LEVEL_SECTIONS,
+} LevelSection;
+
+typedef struct LevelHeader {
+    uint32_t magic;
+    uint32_t version;
+    // of the whole file
+    uint64_t size;
+
+    Vector2 spawn_position;
+    int32_t n_static_obstacles;
+    int32_t n_static_bvh_nodes;
+    int32_t n_platforms;
+    int32_t reserved;
+
+    // from the start of the file
+    uint64_t section_offsets[N_LEVEL_SECTIONS];
+} LevelHeader;
+
+typedef struct MappedLevel {
+    void *data;
+    size_t size;
+} MappedLevel;
+
+// the level the static set points into, if any
+extern MappedLevel MAPPED_LEVEL;
+
+// maps and checks the file into out_level, returns its header, or NULL if
+// it can't be read or isn't a valid level
+const LevelHeader *map_level(const char *path, MappedLevel *out_level);
+void unmap_level(MappedLevel *level);
+const void *get_level_section(const LevelHeader *header, LevelSection section);
+
+// spawns the items of a text level into the reset world, returns false
+// (with the line in out_line) on a line it can't read
+bool load_level_text(const char *path, Vector2 *out_spawn_position, int *out_line);
+
+// writes the static set (built) and the obstacles as a binary level, into
+// a temporary file renamed over the path, so a game that has the previous
+// file mapped keeps reading it intact
+bool save_level(const char *path, Vector2 spawn_position);
+
+// -----------------------------------------------------------------------
+// level watch
+// inotify on the directory of the level file, so a file replaced by a
+// rename is seen as well as one rewritten in place
+typedef struct LevelWatch {
+    int fd;
+    // file name within the watched directory
+    char name[256];
+} LevelWatch;
+
+// returns false if the directory can't be watched
+bool watch_level(LevelWatch *watch, const char *path);
+
+// returns true if the file was written or replaced since the last poll,
+// doesn't block
+bool poll_level_watch(LevelWatch *watch);
+void unwatch_level(LevelWatch *watch);
@@ -1,72 +1,42 @@
-#include "inttypes.h"
 #include "raylib.h"
 #include "raymath.h"
+#include "rlgl.h"
+#include "profiler.h"
+#include "sim.h"
+#include "triple_buffer.h"
 #include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
 #define SCREEN_WIDTH 1024
 #define SCREEN_HEIGHT 1024
 
-#define GRAVITY_ACCELERATION 50.0
-#define MAX_N_OBSTACLES 64
-
-#define PLAYER_MAX_HEALTH 100.0
-#define MAX_SPEED_WITHOUT_DAMAGE 30.0
+#define DEFAULT_TARGET_FPS 60
 
 static const Color BACKGROUND_COLOR = {20, 20, 20, 255};
 static const Color OBSTACLE_COLOR = {80, 80, 80, 255};
 static const Color UI_BACKGROUND_COLOR = {40, 40, 40, 255};
 
-typedef struct Player {
-    Vector2 position;
-    Vector2 velocity;
-    Vector2 size;
-
-    float speed;
-    float jump_impulse;
+static int TARGET_FPS = DEFAULT_TARGET_FPS;
 
-    float health;
-    float max_health;
+// world seed, from the clock unless given
+static uint64_t SEED;
+static bool IS_SEED_SET = false;
+static const char *RECORD_PATH = NULL;
+static const char *PLAY_PATH = NULL;
 
-    bool is_grounded;
-} Player;
+// the level file, patched into the running level when it changes
+static LevelWatch LEVEL_WATCH = {.fd = -1};
 
-static Player PLAYER = {0};
+// the agent controlled by the keyboard and followed by the camera
+#define PLAYER_AGENT 0
 
 // -----------------------------------------------------------------------
 // utils
-
-// returns float uniform value from 0 to 1
-float randf(void) {
-    return GetRandomValue(0, INT32_MAX) / (float)INT32_MAX;
-}
-
-// returns float uniform value from min to max
-float randf_min_max(float min, float max) {
-    float p = randf();
-    return min + p * (max - min);
-}
-
-Vector2 get_aabb_mtv(Rectangle r1, Rectangle r2) {
-    Vector2 mtv = Vector2Zero();
-    if (!CheckCollisionRecs(r1, r2)) return mtv;
-
-    float x_west = r2.x - r1.x - r1.width;
-    float x_east = r2.x + r2.width - r1.x;
-    if (fabs(x_west) < fabs(x_east)) mtv.x = x_west;
-    else mtv.x = x_east;
-
-    float y_south = r2.y + r2.height - r1.y;
-    float y_north = r2.y - r1.y - r1.height;
-    if (fabs(y_south) < fabs(y_north)) mtv.y = y_south;
-    else mtv.y = y_north;
-
-    if (fabsf(mtv.x) > fabsf(mtv.y)) mtv.x = 0.0;
-    else mtv.y = 0.0;
-
-    return mtv;
-}
-
 Color lerp_color(Color min_color, Color max_color, float ratio) {
     return (Color){
         .r = (1.0 - ratio) * min_color.r + ratio * max_color.r,
@@ -76,6 +46,22 @@ Color lerp_color(Color min_color, Color max_color, float ratio) {
     };
 }
 
+// monotonic seconds, the simulation thread and the frames share it
+double get_clock(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+// grows the arrays to fit n floats each
+void reserve_floats(int *capacity, int n, float **arrays, int n_arrays) {
+    if (n <= *capacity) return;
+    *capacity = n < 2 * *capacity ? 2 * *capacity : n;
+    for (int i = 0; i < n_arrays; ++i) {
+        arrays[i] = realloc(arrays[i], *capacity * sizeof(float));
+    }
+}
+
 // -----------------------------------------------------------------------
 // camera
 static Camera2D CAMERA = {
@@ -85,88 +71,505 @@ static Camera2D CAMERA = {
     .zoom = 20.0,
 };
 
+Rectangle get_camera_view_rect(void) {
+    Vector2 min = GetScreenToWorld2D((Vector2){0.0, 0.0}, CAMERA);
+    Vector2 max = GetScreenToWorld2D((Vector2){SCREEN_WIDTH, SCREEN_HEIGHT}, CAMERA);
+    return (Rectangle){min.x, min.y, max.x - min.x, max.y - min.y};
+}
+
 // -----------------------------------------------------------------------
-// obstacle
-typedef struct Obstacle {
-    Rectangle rect;
+// quad buffer
+// rects drawn from a vertex buffer as two triangles each, the whole buffer
+// in one draw call instead of one batch quad per rect
+#define QUAD_N_VERTICES 6
+#define QUAD_N_FLOATS (2 * QUAD_N_VERTICES)
+
+typedef struct QuadBuffer {
+    // gpu vertex array and its position buffer
+    unsigned int vao;
+    unsigned int vbo;
+    bool is_dynamic;
+
+    // quads the buffer fits, and holds since the last upload
+    int capacity;
+    int n;
+
+    // staging vertices, QUAD_N_FLOATS per quad
+    float *vertices;
+} QuadBuffer;
+
+// grows the staging and the gpu buffer (dropping the content) to fit the
+// quads
+void reserve_quad_buffer(QuadBuffer *buffer, int capacity) {
+    if (capacity <= buffer->capacity) return;
+    capacity = capacity < 2 * buffer->capacity ? 2 * buffer->capacity : capacity;
+
+    size_t size = capacity * QUAD_N_FLOATS * sizeof(float);
+    buffer->vertices = realloc(buffer->vertices, size);
+    if (buffer->vao == 0) buffer->vao = rlLoadVertexArray();
+    if (buffer->vbo != 0) rlUnloadVertexBuffer(buffer->vbo);
+
+    // the attribute binds the buffer loaded just before to the vertex array
+    int position_loc = rlGetShaderLocsDefault()[RL_SHADER_LOC_VERTEX_POSITION];
+    rlEnableVertexArray(buffer->vao);
+    buffer->vbo = rlLoadVertexBuffer(NULL, size, buffer->is_dynamic);
+    rlSetVertexAttribute(position_loc, 2, RL_FLOAT, false, 0, 0);
+    rlEnableVertexAttribute(position_loc);
+    rlDisableVertexArray();
+
+    buffer->capacity = capacity;
+}
+
+void set_quad(QuadBuffer *buffer, int idx, float x, float y, float width, float height) {
+    float right = x + width;
+    float bottom = y + height;
+    float *v = buffer->vertices + idx * QUAD_N_FLOATS;
+    v[0] = x, v[1] = y, v[2] = x, v[3] = bottom, v[4] = right, v[5] = bottom;
+    v[6] = x, v[7] = y, v[8] = right, v[9] = bottom, v[10] = right, v[11] = y;
+}
 
-    // platform
-    Vector2 start;
-    Vector2 end;
-    float speed;
-    bool is_moving_to_start;
-    bool is_player_attached;
-} Obstacle;
+void upload_quad_buffer(QuadBuffer *buffer, int n) {
+    buffer->n = n;
+    if (n == 0) return;
+    int size = n * QUAD_N_FLOATS * sizeof(float);
+    rlUpdateVertexBuffer(buffer->vbo, buffer->vertices, size, 0);
+}
 
-static int N_OBSTACLES = 0;
-static Obstacle OBSTACLES[MAX_N_OBSTACLES] = {0};
+// draws the quads first to first + n - 1 with the default shader and
+// texture, in the current (camera) transform; the vertices have no color or
+// texture coordinates, so they take the constant white and the corner texel
+void draw_quad_buffer(const QuadBuffer *buffer, int first, int n, Color color) {
+    if (n == 0) return;
+
+    // the quads queued in raylib's batch so far are drawn first
+    rlDrawRenderBatchActive();
+
+    int *locs = rlGetShaderLocsDefault();
+    Matrix mvp = MatrixMultiply(rlGetMatrixModelview(), rlGetMatrixProjection());
+    Vector4 diffuse = ColorNormalize(color);
+    Vector4 white = {1.0, 1.0, 1.0, 1.0};
+
+    rlEnableShader(rlGetShaderIdDefault());
+    rlSetUniformMatrix(locs[RL_SHADER_LOC_MATRIX_MVP], mvp);
+    rlSetUniform(locs[RL_SHADER_LOC_COLOR_DIFFUSE], &diffuse, RL_SHADER_UNIFORM_VEC4, 1);
+    rlActiveTextureSlot(0);
+    rlEnableTexture(rlGetTextureIdDefault());
+
+    rlEnableVertexArray(buffer->vao);
+    rlSetVertexAttributeDefault(
+        locs[RL_SHADER_LOC_VERTEX_COLOR], &white, RL_SHADER_ATTRIB_VEC4, 4
+    );
+    rlDrawVertexArray(first * QUAD_N_VERTICES, n * QUAD_N_VERTICES);
+    rlDisableVertexArray();
 
-int spawn_obstacle(Rectangle rect, Vector2 start, Vector2 end, float speed) {
-    if (N_OBSTACLES == MAX_N_OBSTACLES) return -1;
+    rlDisableTexture();
+    rlDisableShader();
+}
 
-    int idx = N_OBSTACLES++;
-    Obstacle *obstacle = &OBSTACLES[idx];
-    obstacle->rect = rect;
-    obstacle->start = start;
-    obstacle->end = end;
-    obstacle->speed = speed;
+void unload_quad_buffer(QuadBuffer *buffer) {
+    if (buffer->vbo != 0) rlUnloadVertexBuffer(buffer->vbo);
+    if (buffer->vao != 0) rlUnloadVertexArray(buffer->vao);
+    free(buffer->vertices);
+    *buffer = (QuadBuffer){.is_dynamic = buffer->is_dynamic};
+}
+
+// -----------------------------------------------------------------------
+// world snapshot
+// what a frame draws, copied out of the simulation by its thread after
+// each step and handed to the frames through a triple buffer, so drawing
+// never reads the simulation while it's stepped, and neither side waits
+// on the other
+
+// the pool obstacles are culled at their positions after the tick, the
+// drawn ones lag them by up to a tick of movement
+#define VIEW_QUERY_MARGIN 4.0
+
+typedef struct WorldSnapshot {
+    // when it was published, and the tick alpha and dt then
+    double time;
+    float alpha;
+    float tick_dt;
+
+    // agents before and after the last tick
+    int n_agents;
+    int agents_capacity;
+    float *agent_prev_x;
+    float *agent_prev_y;
+    float *agent_x;
+    float *agent_y;
+    Vector2 agent_size;
+
+    float health;
+    float max_health;
 
-    return idx;
+    // obstacles in the camera view (as the frames last reported it), and
+    // in all, static and in the pool
+    int n_visible_static;
+    int n_static;
+    int n_visible;
+    int n;
+
+    // the static set, copied only when its revision changes
+    uint32_t static_revision;
+    int static_capacity;
+    float *static_x;
+    float *static_y;
+    float *static_width;
+    float *static_height;
+
+    // span of the static set to draw, from the first visible quad to the
+    // last one
+    int first_drawn_static;
+    int n_drawn_static;
+
+    // pool obstacles around the view, before and after the last tick
+    int n_obstacles;
+    int obstacles_capacity;
+    float *obstacle_prev_x;
+    float *obstacle_prev_y;
+    float *obstacle_x;
+    float *obstacle_y;
+    float *obstacle_width;
+    float *obstacle_height;
+} WorldSnapshot;
+
+static WorldSnapshot SNAPSHOTS[TRIPLE_BUFFER_N_SLOTS];
+static TripleBuffer SNAPSHOT_BUFFER;
+
+// query scratch of the simulation thread
+static int SNAPSHOT_IDS_CAPACITY = 0;
+static int *SNAPSHOT_IDS;
+
+void init_snapshots(void) {
+    init_triple_buffer(&SNAPSHOT_BUFFER);
+    for (int i = 0; i < TRIPLE_BUFFER_N_SLOTS; ++i) {
+        SNAPSHOTS[i] = (WorldSnapshot){.static_revision = UINT32_MAX};
+    }
 }
 
-int spawn_static_obstacle(Rectangle rect) {
-    Vector2 direction = Vector2Zero();
-    Vector2 start = {rect.x, rect.y};
-    Vector2 end = start;
-    float speed = 0.0;
-    return spawn_obstacle(rect, start, end, speed);
+void snapshot_agents(WorldSnapshot *snapshot) {
+    int n = AGENTS.n;
+    float *arrays[] = {
+        snapshot->agent_prev_x,
+        snapshot->agent_prev_y,
+        snapshot->agent_x,
+        snapshot->agent_y,
+    };
+    reserve_floats(&snapshot->agents_capacity, n, arrays, 4);
+    snapshot->agent_prev_x = arrays[0];
+    snapshot->agent_prev_y = arrays[1];
+    snapshot->agent_x = arrays[2];
+    snapshot->agent_y = arrays[3];
+
+    memcpy(snapshot->agent_prev_x, AGENTS.prev_x, n * sizeof(float));
+    memcpy(snapshot->agent_prev_y, AGENTS.prev_y, n * sizeof(float));
+    memcpy(snapshot->agent_x, AGENTS.x, n * sizeof(float));
+    memcpy(snapshot->agent_y, AGENTS.y, n * sizeof(float));
+    snapshot->n_agents = n;
+    snapshot->agent_size = AGENTS.size;
+
+    snapshot->health = AGENTS.health[PLAYER_AGENT];
+    snapshot->max_health = AGENTS.max_health;
 }
 
-void draw_obstacles(void) {
-    for (int i = 0; i < N_OBSTACLES; ++i) {
-        Obstacle *obstacle = &OBSTACLES[i];
-        DrawRectangleRec(obstacle->rect, OBSTACLE_COLOR);
+// the static tree stores its leaves in order, so the visible static
+// obstacles are close together in the set and are drawn as one span in one
+// draw call; the hidden quads inside the span are clipped by the gpu, which
+// costs less than a draw call per run of visible ones
+void snapshot_static_obstacles(WorldSnapshot *snapshot, Rectangle view_rect) {
+    build_static_obstacles();
+    int n = STATIC_OBSTACLES.n;
+    snapshot->n_static = n;
+    if (snapshot->static_revision != STATIC_OBSTACLES.revision) {
+        float *arrays[] = {
+            snapshot->static_x,
+            snapshot->static_y,
+            snapshot->static_width,
+            snapshot->static_height,
+        };
+        reserve_floats(&snapshot->static_capacity, n, arrays, 4);
+        snapshot->static_x = arrays[0];
+        snapshot->static_y = arrays[1];
+        snapshot->static_width = arrays[2];
+        snapshot->static_height = arrays[3];
+
+        memcpy(snapshot->static_x, STATIC_OBSTACLES.x, n * sizeof(float));
+        memcpy(snapshot->static_y, STATIC_OBSTACLES.y, n * sizeof(float));
+        memcpy(snapshot->static_width, STATIC_OBSTACLES.width, n * sizeof(float));
+        memcpy(snapshot->static_height, STATIC_OBSTACLES.height, n * sizeof(float));
+        snapshot->static_revision = STATIC_OBSTACLES.revision;
     }
+
+    int n_ids = query_static_obstacles(view_rect, SNAPSHOT_IDS);
+    int first = n;
+    int last = -1;
+    snapshot->n_visible_static = 0;
+    for (int i = 0; i < n_ids; ++i) {
+        int id = SNAPSHOT_IDS[i];
+        if (!CheckCollisionRecs(get_static_obstacle_rect(id), view_rect)) continue;
+        snapshot->n_visible_static += 1;
+        first = id < first ? id : first;
+        last = id > last ? id : last;
+    }
+    snapshot->first_drawn_static = first;
+    snapshot->n_drawn_static = last >= first ? last - first + 1 : 0;
 }
 
-void draw_ui(void) {
-    static const float margin = 10.0;
-    static const float pad = 5.0;
+void snapshot_obstacles(WorldSnapshot *snapshot, Rectangle view_rect) {
+    Rectangle query_rect = {
+        .x = view_rect.x - VIEW_QUERY_MARGIN,
+        .y = view_rect.y - VIEW_QUERY_MARGIN,
+        .width = view_rect.width + 2.0 * VIEW_QUERY_MARGIN,
+        .height = view_rect.height + 2.0 * VIEW_QUERY_MARGIN,
+    };
+    int n_ids = query_obstacles(query_rect, SNAPSHOT_IDS);
+
+    float *arrays[] = {
+        snapshot->obstacle_prev_x,
+        snapshot->obstacle_prev_y,
+        snapshot->obstacle_x,
+        snapshot->obstacle_y,
+        snapshot->obstacle_width,
+        snapshot->obstacle_height,
+    };
+    reserve_floats(&snapshot->obstacles_capacity, n_ids, arrays, 6);
+    snapshot->obstacle_prev_x = arrays[0];
+    snapshot->obstacle_prev_y = arrays[1];
+    snapshot->obstacle_x = arrays[2];
+    snapshot->obstacle_y = arrays[3];
+    snapshot->obstacle_width = arrays[4];
+    snapshot->obstacle_height = arrays[5];
+
+    snapshot->n = OBSTACLES.n;
+    snapshot->n_visible = 0;
+    snapshot->n_obstacles = 0;
+    for (int i = 0; i < n_ids; ++i) {
+        int id = SNAPSHOT_IDS[i];
+        Rectangle rect = get_obstacle_rect(id);
+        if (!CheckCollisionRecs(rect, query_rect)) continue;
+        if (CheckCollisionRecs(rect, view_rect)) snapshot->n_visible += 1;
+
+        int j = snapshot->n_obstacles++;
+        snapshot->obstacle_prev_x[j] = OBSTACLES.prev_x[id];
+        snapshot->obstacle_prev_y[j] = OBSTACLES.prev_y[id];
+        snapshot->obstacle_x[j] = rect.x;
+        snapshot->obstacle_y[j] = rect.y;
+        snapshot->obstacle_width[j] = rect.width;
+        snapshot->obstacle_height[j] = rect.height;
+    }
+}
 
-    float dt = GetFrameTime();
+// called by the simulation thread (or before it starts)
+void publish_snapshot(Rectangle view_rect) {
+    int capacity = STATIC_OBSTACLES.n > OBSTACLES.capacity ? STATIC_OBSTACLES.n
+                                                           : OBSTACLES.capacity;
+    if (capacity > SNAPSHOT_IDS_CAPACITY) {
+        SNAPSHOT_IDS_CAPACITY = capacity;
+        SNAPSHOT_IDS = realloc(SNAPSHOT_IDS, capacity * sizeof(int));
+    }
 
-    // -------------------------------------------------------------------
-    // healthbar
-    static const float width = 300.0;
-    static const float height = 40.0;
-    static float health_view_speed = 80.0;
-    static float health_view = PLAYER_MAX_HEALTH;
+    WorldSnapshot *snapshot = &SNAPSHOTS[SNAPSHOT_BUFFER.write_slot];
+    snapshot->time = get_clock();
+    snapshot->alpha = get_tick_alpha();
+    snapshot->tick_dt = get_tick_dt();
+    snapshot_agents(snapshot);
+    snapshot_static_obstacles(snapshot, view_rect);
+    snapshot_obstacles(snapshot, view_rect);
+
+    publish_triple_buffer(&SNAPSHOT_BUFFER);
+}
+
+// the tick alpha of the snapshot moved on by the time since it was taken,
+// the states in between aren't simulated yet, so it stops at the last one
+float get_snapshot_alpha(const WorldSnapshot *snapshot, double time) {
+    float alpha = snapshot->alpha + (time - snapshot->time) / snapshot->tick_dt;
+    return alpha < 1.0 ? alpha : 1.0;
+}
+
+Vector2 get_snapshot_agent_position(const WorldSnapshot *snapshot, int idx, float alpha) {
+    return (Vector2){
+        Lerp(snapshot->agent_prev_x[idx], snapshot->agent_x[idx], alpha),
+        Lerp(snapshot->agent_prev_y[idx], snapshot->agent_y[idx], alpha),
+    };
+}
+
+void free_snapshots(void) {
+    for (int i = 0; i < TRIPLE_BUFFER_N_SLOTS; ++i) {
+        WorldSnapshot *snapshot = &SNAPSHOTS[i];
+        free(snapshot->agent_prev_x);
+        free(snapshot->agent_prev_y);
+        free(snapshot->agent_x);
+        free(snapshot->agent_y);
+        free(snapshot->static_x);
+        free(snapshot->static_y);
+        free(snapshot->static_width);
+        free(snapshot->static_height);
+        free(snapshot->obstacle_prev_x);
+        free(snapshot->obstacle_prev_y);
+        free(snapshot->obstacle_x);
+        free(snapshot->obstacle_y);
+        free(snapshot->obstacle_width);
+        free(snapshot->obstacle_height);
+        SNAPSHOTS[i] = (WorldSnapshot){0};
+    }
+    free(SNAPSHOT_IDS);
+    SNAPSHOT_IDS = NULL;
+    SNAPSHOT_IDS_CAPACITY = 0;
+}
+
+// the snapshot the frame draws and its alpha
+static const WorldSnapshot *SNAPSHOT;
+static float SNAPSHOT_ALPHA;
+
+// -----------------------------------------------------------------------
+// obstacle
+// the static set is uploaded when a snapshot brings a new revision and
+// drawn in runs over its visible part, the pool obstacles around the view
+// are rewritten every frame at the interpolated positions
+static QuadBuffer STATIC_OBSTACLE_QUADS = {.is_dynamic = false};
+static QuadBuffer OBSTACLE_QUADS = {.is_dynamic = true};
+
+// revision of the static set in STATIC_OBSTACLE_QUADS
+static uint32_t STATIC_OBSTACLE_QUADS_REVISION = 0;
+
+// interpolated positions of the pool obstacles in the snapshot
+static int OBSTACLE_VIEW_CAPACITY = 0;
+static float *OBSTACLE_VIEW_X;
+static float *OBSTACLE_VIEW_Y;
+
+void update_static_obstacle_quads(const WorldSnapshot *snapshot) {
+    if (STATIC_OBSTACLE_QUADS.vao != 0
+        && snapshot->static_revision == STATIC_OBSTACLE_QUADS_REVISION) {
+        return;
+    }
+
+    int n = snapshot->n_static;
+    reserve_quad_buffer(&STATIC_OBSTACLE_QUADS, n > 0 ? n : 1);
+    for (int i = 0; i < n; ++i) {
+        set_quad(
+            &STATIC_OBSTACLE_QUADS,
+            i,
+            snapshot->static_x[i],
+            snapshot->static_y[i],
+            snapshot->static_width[i],
+            snapshot->static_height[i]
+        );
+    }
+    upload_quad_buffer(&STATIC_OBSTACLE_QUADS, n);
+    STATIC_OBSTACLE_QUADS_REVISION = snapshot->static_revision;
+}
+
+void update_obstacle_quads(const WorldSnapshot *snapshot, float alpha) {
+    int n = snapshot->n_obstacles;
+    float *arrays[] = {OBSTACLE_VIEW_X, OBSTACLE_VIEW_Y};
+    reserve_floats(&OBSTACLE_VIEW_CAPACITY, n, arrays, 2);
+    OBSTACLE_VIEW_X = arrays[0];
+    OBSTACLE_VIEW_Y = arrays[1];
+    KERNELS->lerp_floats(
+        snapshot->obstacle_prev_x, snapshot->obstacle_x, alpha, OBSTACLE_VIEW_X, n
+    );
+    KERNELS->lerp_floats(
+        snapshot->obstacle_prev_y, snapshot->obstacle_y, alpha, OBSTACLE_VIEW_Y, n
+    );
 
-    // update health view
-    if (PLAYER.health < health_view) {
+    reserve_quad_buffer(&OBSTACLE_QUADS, n > 0 ? n : 1);
+    for (int i = 0; i < n; ++i) {
+        set_quad(
+            &OBSTACLE_QUADS,
+            i,
+            OBSTACLE_VIEW_X[i],
+            OBSTACLE_VIEW_Y[i],
+            snapshot->obstacle_width[i],
+            snapshot->obstacle_height[i]
+        );
+    }
+    upload_quad_buffer(&OBSTACLE_QUADS, n);
+}
+
+void draw_obstacles(const WorldSnapshot *snapshot, float alpha) {
+    update_static_obstacle_quads(snapshot);
+    update_obstacle_quads(snapshot, alpha);
+
+    draw_quad_buffer(
+        &STATIC_OBSTACLE_QUADS,
+        snapshot->first_drawn_static,
+        snapshot->n_drawn_static,
+        OBSTACLE_COLOR
+    );
+    draw_quad_buffer(&OBSTACLE_QUADS, 0, OBSTACLE_QUADS.n, OBSTACLE_COLOR);
+}
+
+void unload_obstacles(void) {
+    unload_quad_buffer(&STATIC_OBSTACLE_QUADS);
+    unload_quad_buffer(&OBSTACLE_QUADS);
+    free(OBSTACLE_VIEW_X);
+    free(OBSTACLE_VIEW_Y);
+    OBSTACLE_VIEW_X = NULL;
+    OBSTACLE_VIEW_Y = NULL;
+    OBSTACLE_VIEW_CAPACITY = 0;
+}
+
+// -----------------------------------------------------------------------
+// ui
+// health shown by the healthbar, drains towards the actual health
+static float HEALTH_VIEW = AGENT_MAX_HEALTH;
+
+void update_health_view(const WorldSnapshot *snapshot, float dt) {
+    static const float health_view_speed = 80.0;
+
+    float health = snapshot->health;
+    if (health < HEALTH_VIEW) {
         float health_view_step = dt * health_view_speed;
-        health_view -= health_view_step;
-        health_view = health_view < PLAYER.health ? PLAYER.health : health_view;
+        HEALTH_VIEW -= health_view_step;
+        HEALTH_VIEW = HEALTH_VIEW < health ? health : HEALTH_VIEW;
     } else {
-        health_view = PLAYER.health;
+        HEALTH_VIEW = health;
     }
+}
 
+// -----------------------------------------------------------------------
+// hud layer
+// the hud is drawn into a render texture, redrawn only when the state its
+// widgets are drawn from changed, and put on the screen as one quad. a
+// widget reads the state only, so adding one means adding its fields to
+// HudState and its function to HUD_WIDGETS. text that changes with the
+// camera (the culling counters) would redraw it every frame, it's drawn
+// over the layer instead
+
+// top left corner of the screen, where the widgets are
+#define HUD_WIDTH 512
+#define HUD_HEIGHT 128
+
+typedef struct HudState {
+    float health;
+    float health_view;
+    float max_health;
+} HudState;
+
+typedef void (*HudWidget)(const HudState *state);
+
+static const float HUD_MARGIN = 10.0;
+static const float HUD_PAD = 5.0;
+static const float HEALTHBAR_WIDTH = 300.0;
+static const float HEALTHBAR_HEIGHT = 40.0;
+
+void draw_healthbar(const HudState *state) {
     // background
     Rectangle background_rect = {
-        .x = margin,
-        .y = margin,
-        .width = width,
-        .height = height,
+        .x = HUD_MARGIN,
+        .y = HUD_MARGIN,
+        .width = HEALTHBAR_WIDTH,
+        .height = HEALTHBAR_HEIGHT,
     };
 
     // healthbar
     Rectangle healthbar_rect = {
-        .x = background_rect.x + pad,
-        .y = background_rect.y + pad,
-        .width = background_rect.width - 2.0 * pad,
-        .height = background_rect.height - 2.0 * pad,
+        .x = background_rect.x + HUD_PAD,
+        .y = background_rect.y + HUD_PAD,
+        .width = background_rect.width - 2.0 * HUD_PAD,
+        .height = background_rect.height - 2.0 * HUD_PAD,
     };
-    float health_ratio = PLAYER.health / PLAYER.max_health;
+    float health_ratio = state->health / state->max_health;
     healthbar_rect.width *= health_ratio;
 
     Color healthbar_color = lerp_color(RED, GREEN, health_ratio);
@@ -175,10 +578,10 @@ void draw_ui(void) {
     Rectangle difference_rect = {
         .x = healthbar_rect.x,
         .y = healthbar_rect.y,
-        .width = background_rect.width - 2.0 * pad,
+        .width = background_rect.width - 2.0 * HUD_PAD,
         .height = healthbar_rect.height,
     };
-    float difference_ratio = health_view / PLAYER.max_health;
+    float difference_ratio = state->health_view / state->max_health;
     difference_rect.width *= difference_ratio;
 
     DrawRectangleRounded(background_rect, 0.2, 16, UI_BACKGROUND_COLOR);
@@ -186,235 +589,546 @@ void draw_ui(void) {
     DrawRectangleRounded(healthbar_rect, 0.2, 16, healthbar_color);
 }
 
-void update_obstacles(void) {
-    float dt = GetFrameTime();
-
-    for (int i = 0; i < N_OBSTACLES; ++i) {
-        Obstacle *obstacle = &OBSTACLES[i];
+static const HudWidget HUD_WIDGETS[] = {
+    draw_healthbar,
+};
 
-        // don't update non-platform obstacles (zero speed)
-        if (!(obstacle->speed > 0.0)) continue;
+typedef struct HudLayer {
+    RenderTexture2D texture;
+    // the state drawn into the texture, is_drawn is false until the first
+    bool is_drawn;
+    HudState state;
+} HudLayer;
 
-        // get platform direction
-        Vector2 direction = Vector2Subtract(obstacle->end, obstacle->start);
-        direction = Vector2Normalize(direction);
-        if (obstacle->is_moving_to_start) direction = Vector2Negate(direction);
+static HudLayer HUD_LAYER;
 
-        // moving (immediate position change)
-        Vector2 position_step = Vector2Scale(direction, dt * obstacle->speed);
-        obstacle->rect.x += position_step.x;
-        obstacle->rect.y += position_step.y;
+void load_hud_layer(void) {
+    HUD_LAYER = (HudLayer){.texture = LoadRenderTexture(HUD_WIDTH, HUD_HEIGHT)};
+}
 
-        if (obstacle->is_player_attached) {
-            PLAYER.position = Vector2Add(PLAYER.position, position_step);
-        }
+void unload_hud_layer(void) {
+    UnloadRenderTexture(HUD_LAYER.texture);
+    HUD_LAYER = (HudLayer){0};
+}
 
-        // reverse platform movement if it reached the target
-        Vector2 position = {obstacle->rect.x, obstacle->rect.y};
-        Vector2 target = obstacle->is_moving_to_start ? obstacle->start : obstacle->end;
-        Vector2 to_target_direction = Vector2Subtract(target, position);
-        bool is_to_target = Vector2DotProduct(direction, to_target_direction) > 0.0;
-        if (!is_to_target) {
-            Vector2 clamped_position;
-            if (obstacle->is_moving_to_start) {
-                clamped_position = obstacle->start;
-            } else {
-                clamped_position = obstacle->end;
-            }
+HudState get_hud_state(const WorldSnapshot *snapshot) {
+    // zeroed padding, the states are compared bytewise
+    HudState state;
+    memset(&state, 0, sizeof(state));
+    state.health = snapshot->health;
+    state.health_view = HEALTH_VIEW;
+    state.max_health = snapshot->max_health;
+    return state;
+}
 
-            obstacle->rect.x = clamped_position.x;
-            obstacle->rect.y = clamped_position.y;
-            obstacle->is_moving_to_start ^= 1;
-        }
+// called before BeginDrawing, the texture can't be drawn into while the
+// screen is
+void update_hud_layer(const WorldSnapshot *snapshot) {
+    HudState state = get_hud_state(snapshot);
+    if (HUD_LAYER.is_drawn && memcmp(&state, &HUD_LAYER.state, sizeof(state)) == 0) {
+        return;
     }
+
+    // the texture keeps premultiplied colors, so the edges blend over the
+    // screen as they would have drawn straight onto it
+    BeginTextureMode(HUD_LAYER.texture);
+    ClearBackground(BLANK);
+    rlSetBlendFactorsSeparate(
+        RL_SRC_ALPHA,
+        RL_ONE_MINUS_SRC_ALPHA,
+        RL_ONE,
+        RL_ONE_MINUS_SRC_ALPHA,
+        RL_FUNC_ADD,
+        RL_FUNC_ADD
+    );
+    BeginBlendMode(BLEND_CUSTOM_SEPARATE);
+    int n_widgets = sizeof(HUD_WIDGETS) / sizeof(HUD_WIDGETS[0]);
+    for (int i = 0; i < n_widgets; ++i) HUD_WIDGETS[i](&state);
+    EndBlendMode();
+    EndTextureMode();
+
+    HUD_LAYER.is_drawn = true;
+    HUD_LAYER.state = state;
+}
+
+void draw_hud_layer(void) {
+    // render textures are stored bottom up
+    Rectangle source = {0.0, 0.0, HUD_WIDTH, -HUD_HEIGHT};
+    BeginBlendMode(BLEND_ALPHA_PREMULTIPLY);
+    DrawTextureRec(HUD_LAYER.texture.texture, source, (Vector2){0.0, 0.0}, WHITE);
+    EndBlendMode();
+}
+
+// changes with every scroll of the camera, so it's drawn every frame
+void draw_culling_counters(const WorldSnapshot *snapshot) {
+    DrawText(
+        TextFormat(
+            "obstacles: %d / %d visible",
+            snapshot->n_visible_static + snapshot->n_visible,
+            snapshot->n_static + snapshot->n
+        ),
+        HUD_MARGIN,
+        HUD_MARGIN + HEALTHBAR_HEIGHT + HUD_PAD,
+        20,
+        WHITE
+    );
 }
 
 // -----------------------------------------------------------------------
-// player
-Rectangle get_player_rect(void) {
-    return (Rectangle){
-        .x = PLAYER.position.x + 0.5 * PLAYER.size.x,
-        .y = PLAYER.position.y + PLAYER.size.y,
-        .width = PLAYER.size.x,
-        .height = PLAYER.size.y,
-    };
+// agent
+void draw_agents(const WorldSnapshot *snapshot, float alpha) {
+    Vector2 size = snapshot->agent_size;
+    for (int i = 0; i < snapshot->n_agents; ++i) {
+        Vector2 position = get_snapshot_agent_position(snapshot, i, alpha);
+        Rectangle rect = {position.x + 0.5 * size.x, position.y + size.y, size.x, size.y};
+        DrawRectangleRec(rect, ORANGE);
+    }
 }
 
-void update_player(void) {
-    float dt = GetFrameTime();
+// -----------------------------------------------------------------------
+// profiler
+// F3 toggles an overlay of the zone stats, --profile FILE appends them to
+// a csv file every PROFILE_DUMP_INTERVAL seconds, --trace FILE records
+// the zones of every thread as a timeline. they need a PROFILE=1 build,
+// they're compiled out with the zones otherwise
+
+// the overlay numbers are refreshed slower than the frames, to be readable
+#define PROFILE_OVERLAY_INTERVAL 0.5
+#define PROFILE_DUMP_INTERVAL 1.0
+
+static const char *PROFILE_PATH = NULL;
+static const char *TRACE_PATH = NULL;
+
+#ifdef PROFILE
+typedef struct ProfileOverlay {
+    bool is_shown;
+    double refresh_time;
+    int n_stats;
+    ProfileStats stats[PROFILE_MAX_ZONES];
+
+    FILE *file;
+    double dump_time;
+} ProfileOverlay;
+
+static ProfileOverlay PROFILE_OVERLAY;
+
+void load_profiler(void) {
+    init_profiler();
+    PROFILE_THREAD_NAME("render");
+    if (TRACE_PATH && start_trace(TRACE_PATH)) {
+        TraceLog(LOG_INFO, "PROFILE: tracing to %s", TRACE_PATH);
+    } else if (TRACE_PATH) {
+        TraceLog(LOG_WARNING, "PROFILE: can't trace to %s", TRACE_PATH);
+    }
+    if (PROFILE_PATH == NULL) return;
 
-    // gravity
-    PLAYER.velocity.y += GRAVITY_ACCELERATION * dt;
+    PROFILE_OVERLAY.file = fopen(PROFILE_PATH, "w");
+    if (PROFILE_OVERLAY.file && write_profile_csv_header(PROFILE_OVERLAY.file)) {
+        TraceLog(LOG_INFO, "PROFILE: writing %s", PROFILE_PATH);
+    } else {
+        TraceLog(LOG_WARNING, "PROFILE: can't write %s", PROFILE_PATH);
+    }
+}
 
-    // -------------------------------------------------------------------
-    // keyboard inputs
+void update_profiler(void) {
+    ProfileOverlay *overlay = &PROFILE_OVERLAY;
+    double time = GetTime();
+    if (IsKeyPressed(KEY_F3)) {
+        overlay->is_shown = !overlay->is_shown;
+        overlay->refresh_time = 0.0;
+    }
 
-    // moving (immediate position change)
-    Vector2 direction = Vector2Zero();
-    if (IsKeyDown(KEY_A)) direction.x -= 1.0;
-    if (IsKeyDown(KEY_D)) direction.x += 1.0;
+    if (overlay->is_shown && time >= overlay->refresh_time) {
+        overlay->n_stats = get_profile_stats(overlay->stats);
+        overlay->refresh_time = time + PROFILE_OVERLAY_INTERVAL;
+    }
+    if (overlay->file && time >= overlay->dump_time) {
+        write_profile_csv(overlay->file, time);
+        overlay->dump_time = time + PROFILE_DUMP_INTERVAL;
+    }
+}
 
-    direction = Vector2Normalize(direction);
-    Vector2 position_step = Vector2Scale(direction, PLAYER.speed * dt);
+void draw_profile_overlay(void) {
+    static const int font_size = 10;
+    static const int line_height = 12;
+    static const int indent = 8;
+    static const int width = 400;
+    static const int margin = 10;
+    static const int pad = 5;
+    // right edges of the number columns
+    static const int columns[] = {230, 285, 340, 395};
+
+    const ProfileOverlay *overlay = &PROFILE_OVERLAY;
+    if (!overlay->is_shown) return;
+
+    int x = SCREEN_WIDTH - margin - width;
+    int y = margin;
+    int height = (overlay->n_stats + 1) * line_height + 2 * pad;
+    DrawRectangle(x, y, width, height, Fade(UI_BACKGROUND_COLOR, 0.9));
+    x += pad;
+    y += pad;
+
+    const char *header[] = {"calls", "min us", "avg us", "p99 us"};
+    DrawText("zone", x, y, font_size, LIGHTGRAY);
+    for (int i = 0; i < 4; ++i) {
+        int text_width = MeasureText(header[i], font_size);
+        DrawText(header[i], x + columns[i] - text_width, y, font_size, LIGHTGRAY);
+    }
 
-    // jumping (velocity change)
-    if (IsKeyPressed(KEY_W) && PLAYER.is_grounded) {
-        PLAYER.velocity.y -= PLAYER.jump_impulse;
+    for (int i = 0; i < overlay->n_stats; ++i) {
+        const ProfileStats *stats = &overlay->stats[i];
+        y += line_height;
+        DrawText(stats->name, x + stats->depth * indent, y, font_size, WHITE);
+
+        const char *values[] = {
+            TextFormat("%llu", (unsigned long long)stats->n_calls),
+            TextFormat("%.1f", stats->min_us),
+            TextFormat("%.1f", stats->avg_us),
+            TextFormat("%.1f", stats->p99_us),
+        };
+        for (int j = 0; j < 4; ++j) {
+            int text_width = MeasureText(values[j], font_size);
+            DrawText(values[j], x + columns[j] - text_width, y, font_size, WHITE);
+        }
     }
+}
 
-    // velocity
-    position_step = Vector2Add(position_step, Vector2Scale(PLAYER.velocity, dt));
+// after the other threads are stopped, the trace frees their rings
+void unload_profiler(void) {
+    uint64_t n_dropped = stop_trace();
+    if (n_dropped > 0) {
+        TraceLog(
+            LOG_WARNING,
+            "PROFILE: %llu trace events dropped",
+            (unsigned long long)n_dropped
+        );
+    }
 
-    // apply position step
-    PLAYER.position = Vector2Add(PLAYER.position, position_step);
+    if (PROFILE_OVERLAY.file == NULL) return;
+    write_profile_csv(PROFILE_OVERLAY.file, GetTime());
+    fclose(PROFILE_OVERLAY.file);
+    PROFILE_OVERLAY.file = NULL;
+}
+#else
+void load_profiler(void) {
+    if (PROFILE_PATH || TRACE_PATH) {
+        TraceLog(LOG_WARNING, "PROFILE: built without PROFILE=1");
+    }
 }
 
-void update_player_collisions(void) {
-    float mtv_min_x = 0.0;
-    float mtv_max_x = 0.0;
-    float mtv_min_y = 0.0;
-    float mtv_max_y = 0.0;
-    for (int i = 0; i < N_OBSTACLES; ++i) {
-        Obstacle *obstacle = &OBSTACLES[i];
-        Rectangle obstacle_rect = obstacle->rect;
-        Rectangle player_rect = get_player_rect();
+void update_profiler(void) {}
+void draw_profile_overlay(void) {}
+void unload_profiler(void) {}
+#endif
 
-        Vector2 mtv = get_aabb_mtv(player_rect, obstacle_rect);
+// -----------------------------------------------------------------------
+// simulation thread
+// the simulation is stepped by its own thread at the tick rate, apart
+// from the frames: they hand it the keyboard and the camera view, and
+// take the snapshot it published last. the handover is a small mutex the
+// thread takes once per step, the snapshots don't lock
+typedef struct SimInput {
+    // INPUT_* of the player, the jump stays set until a step takes it
+    uint32_t input;
+    bool is_reset_requested;
+    Rectangle view_rect;
+} SimInput;
+
+typedef struct SimThread {
+    pthread_t thread;
+    bool is_running;
+    atomic_bool is_stopping;
+
+    // the fields below are guarded by the mutex
+    pthread_mutex_t mutex;
+    SimInput input;
+
+    // owned by the thread: the input of the step and the clock of the
+    // last one
+    SimInput step_input;
+    double step_clock;
+} SimThread;
+
+static SimThread SIM_THREAD = {.mutex = PTHREAD_MUTEX_INITIALIZER};
+
+// called by the frames
+void update_sim_input(void) {
+    uint32_t input = 0;
+    if (IsKeyDown(KEY_A)) input |= INPUT_LEFT;
+    if (IsKeyDown(KEY_D)) input |= INPUT_RIGHT;
+
+    pthread_mutex_lock(&SIM_THREAD.mutex);
+    SimInput *sim_input = &SIM_THREAD.input;
+    sim_input->input = (sim_input->input & INPUT_JUMP) | input;
+    if (IsKeyPressed(KEY_W)) sim_input->input |= INPUT_JUMP;
+    if (IsKeyPressed(KEY_R)) sim_input->is_reset_requested = true;
+    sim_input->view_rect = get_camera_view_rect();
+    pthread_mutex_unlock(&SIM_THREAD.mutex);
+}
 
-        mtv_min_x = fminf(mtv_min_x, mtv.x);
-        mtv_max_x = fmaxf(mtv_max_x, mtv.x);
-        mtv_min_y = fminf(mtv_min_y, mtv.y);
-        mtv_max_y = fmaxf(mtv_max_y, mtv.y);
+void take_sim_input(void) {
+    pthread_mutex_lock(&SIM_THREAD.mutex);
+    SIM_THREAD.step_input = SIM_THREAD.input;
+    SIM_THREAD.input.input &= ~INPUT_JUMP;
+    SIM_THREAD.input.is_reset_requested = false;
+    pthread_mutex_unlock(&SIM_THREAD.mutex);
+}
 
-        // attach player to the platform if needed
-        obstacle->is_player_attached = mtv.y < 0.0 && obstacle->speed > 0.0;
-    }
+// -----------------------------------------------------------------------
+// host
+// called by the simulation thread
+uint32_t get_step_input(void *user, int agent) {
+    if (agent != PLAYER_AGENT) return 0;
+    return SIM_THREAD.step_input.input;
+}
 
-    Vector2 mtv = {mtv_min_x, mtv_min_y};
-    if (fabsf(mtv_max_x) > fabsf(mtv_min_x)) mtv.x = mtv_max_x;
-    if (fabsf(mtv_max_y) > fabsf(mtv_min_y)) mtv.y = mtv_max_y;
-    PLAYER.position = Vector2Add(PLAYER.position, mtv);
+float get_step_frame_time(void *user) {
+    double clock = get_clock();
+    float dt = clock - SIM_THREAD.step_clock;
+    SIM_THREAD.step_clock = clock;
+    return dt;
+}
 
-    bool is_just_grounded = mtv.y < 0.0 && PLAYER.velocity.y > 0.0;
-    if (is_just_grounded) {
-        float speed = Vector2Length(PLAYER.velocity);
-        float damage = speed - MAX_SPEED_WITHOUT_DAMAGE;
-        damage = damage < 0.0 ? 0.0 : damage;
+// -----------------------------------------------------------------------
+// update
+// a playback loads the levels of the recording
+void update_reset(void) {
+    if (REPLAY.mode == REPLAY_PLAYING) return;
+    if (SIM_THREAD.step_input.is_reset_requested) load_game();
+}
 
-        PLAYER.health -= damage;
+// the patches aren't recorded, so the level is watched only outside of
+// the replays
+void update_level_reload(void) {
+    if (!poll_level_watch(&LEVEL_WATCH)) return;
 
-        PLAYER.velocity = Vector2Zero();
-        PLAYER.is_grounded = true;
-    } else if (mtv.y > 0.0 && PLAYER.velocity.y < 0.0) {
-        PLAYER.velocity.y = 0.0;
-    } else {
-        PLAYER.is_grounded = false;
+    LevelPatch patch;
+    if (!reload_level(&patch)) {
+        TraceLog(LOG_WARNING, "LEVEL: can't reload %s", LEVEL_PATH);
+        return;
     }
+    TraceLog(
+        LOG_INFO,
+        "LEVEL: reloaded %s, static %s, platforms %d changed, %d added, %d removed",
+        LEVEL_PATH,
+        patch.is_static_changed ? "changed" : "kept",
+        patch.n_changed_platforms,
+        patch.n_added_platforms,
+        patch.n_removed_platforms
+    );
 }
 
-void draw_player(void) {
-    Rectangle rect = get_player_rect();
-    DrawRectangleRec(rect, ORANGE);
+// steps until stopped, sleeping out the rest of each tick
+void *run_sim_thread(void *arg) {
+    PROFILE_THREAD_NAME("simulation");
+    SIM_THREAD.step_clock = get_clock();
+    while (!atomic_load(&SIM_THREAD.is_stopping)) {
+        {
+            PROFILE_ZONE("sim_step");
+            take_sim_input();
+            update_level_reload();
+            update_reset();
+            {
+                PROFILE_ZONE("update_simulation");
+                update_simulation();
+            }
+            PROFILE_ZONE("publish_snapshot");
+            publish_snapshot(SIM_THREAD.step_input.view_rect);
+        }
+
+        double wait = get_tick_dt() - TICK_ACCUMULATOR;
+        if (wait <= 0.0) continue;
+        struct timespec ts = {.tv_sec = (time_t)wait};
+        ts.tv_nsec = (long)((wait - ts.tv_sec) * 1e9);
+        nanosleep(&ts, NULL);
+    }
+    return NULL;
 }
 
-// -----------------------------------------------------------------------
-// game
-void load_game(void) {
-    // player
-    PLAYER.position = Vector2Zero();
-    PLAYER.velocity = Vector2Zero();
-    PLAYER.size = (Vector2){1.0, 2.0};
-    PLAYER.speed = 15.0;
-    PLAYER.jump_impulse = 30.0;
+void start_sim_thread(void) {
+    atomic_store(&SIM_THREAD.is_stopping, false);
+    SIM_THREAD.is_running = pthread_create(&SIM_THREAD.thread, NULL, run_sim_thread, NULL)
+                            == 0;
+    if (!SIM_THREAD.is_running) TraceLog(LOG_ERROR, "SIM: can't start the thread");
+}
 
-    PLAYER.max_health = PLAYER_MAX_HEALTH;
-    PLAYER.health = PLAYER.max_health;
+void stop_sim_thread(void) {
+    if (!SIM_THREAD.is_running) return;
+    atomic_store(&SIM_THREAD.is_stopping, true);
+    pthread_join(SIM_THREAD.thread, NULL);
+    SIM_THREAD.is_running = false;
+}
 
-    N_OBSTACLES = 0;
+// -----------------------------------------------------------------------
+// frame
+// camera follows the rendered (interpolated) player agent, so it's updated
+// once per frame rather than once per tick
+void update_camera(const WorldSnapshot *snapshot, float dt, float alpha) {
+    // close 10% of the distance every 1/60 s, whatever the frame rate is
+    static const float follow_ratio = 0.1;
+    float step_ratio = 1.0 - powf(1.0 - follow_ratio, 60.0 * dt);
+
+    Vector2 target = get_snapshot_agent_position(snapshot, PLAYER_AGENT, alpha);
+    float distance = Vector2Distance(target, CAMERA.target);
+    Vector2 direction = Vector2Normalize(Vector2Subtract(target, CAMERA.target));
+    Vector2 position_step = Vector2Scale(direction, step_ratio * distance);
 
-    // ground
-    spawn_static_obstacle((Rectangle){.x = -20.0, .y = 20.0, .width = 40.0, .height = 2.5}
-    );
+    CAMERA.target = Vector2Add(CAMERA.target, position_step);
+}
 
-    // left wall
-    spawn_static_obstacle((Rectangle
-    ){.x = -20.0, .y = -100.0, .width = 2.5, .height = 120.0});
+// the frames don't touch the simulation (the job pool takes one submitter,
+// and that's the simulation thread), they only smooth the latest snapshot
+void update_frame(void) {
+    PROFILE_ZONE("update_frame");
+    int slot = acquire_triple_buffer(&SNAPSHOT_BUFFER);
+    SNAPSHOT = &SNAPSHOTS[slot];
+    SNAPSHOT_ALPHA = get_snapshot_alpha(SNAPSHOT, get_clock());
 
-    // left stair
-    spawn_static_obstacle((Rectangle){.x = -17.5, .y = 15.0, .width = 2.5, .height = 5.0}
+    float dt = GetFrameTime();
+    {
+        PROFILE_ZONE("update_camera");
+        update_camera(SNAPSHOT, dt, SNAPSHOT_ALPHA);
+    }
+    update_health_view(SNAPSHOT, dt);
+    update_profiler();
+    PROFILE_COUNTER(
+        "visible_obstacles", SNAPSHOT->n_visible_static + SNAPSHOT->n_visible
     );
 
-    // right wall
-    spawn_static_obstacle((Rectangle
-    ){.x = 17.5, .y = -100.0, .width = 2.5, .height = 120.0});
-
-    // platforms
-    float x_min = -15.0;
-    float x_max = 5.0;
-    for (int i = 0; i < 10; ++i) {
-        float y = 8.0 - i * 8.0;
-        float x = randf_min_max(x_min, x_max);
-        float speed = randf_min_max(5.0, 9.0);
-
-        spawn_obstacle(
-            (Rectangle){.x = x, .y = y, .width = 10.0, .height = 2.5},
-            (Vector2){.x = x_min, .y = y},
-            (Vector2){.x = x_max, .y = y},
-            speed
-        );
-    }
+    // after the camera, so the thread culls to the view drawn
+    update_sim_input();
 }
 
+// -----------------------------------------------------------------------
+// game
 void load(void) {
     // raylib window
     SetConfigFlags(FLAG_MSAA_4X_HINT);
     InitWindow(SCREEN_WIDTH, SCREEN_HEIGHT, "Platforms");
-    SetTargetFPS(60);
-
-    load_game();
-}
+    SetTargetFPS(TARGET_FPS);
+
+    init_kernels();
+    TraceLog(LOG_INFO, "KERNELS: %s", KERNELS->name);
+    init_job_pool(0);
+    init_snapshots();
+    load_hud_layer();
+    load_profiler();
+
+    SIM_HOST = (SimHost){
+        .user = NULL,
+        .get_input = get_step_input,
+        .get_frame_time = get_step_frame_time,
+    };
 
-void update_reset(void) {
-    if (IsKeyPressed(KEY_R)) load_game();
-}
+    if (PLAY_PATH && start_playback(PLAY_PATH)) {
+        TraceLog(LOG_INFO, "REPLAY: playing %s", PLAY_PATH);
+    } else {
+        if (!IS_SEED_SET) SEED = time(NULL);
+        if (RECORD_PATH && start_recording(RECORD_PATH, SEED)) {
+            TraceLog(LOG_INFO, "REPLAY: recording %s", RECORD_PATH);
+        } else {
+            seed_random(SEED);
+        }
+        TraceLog(LOG_INFO, "SEED: %llu", (unsigned long long)SEED);
+        if (!load_game()) TraceLog(LOG_WARNING, "LEVEL: can't load %s", LEVEL_PATH);
+    }
 
-void update_camera() {
-    Vector2 target = PLAYER.position;
-    float distance = Vector2Distance(target, CAMERA.target);
-    Vector2 direction = Vector2Normalize(Vector2Subtract(target, CAMERA.target));
-    Vector2 position_step = Vector2Scale(direction, 0.1 * distance);
+    if (LEVEL_PATH && REPLAY.mode == REPLAY_OFF) {
+        if (watch_level(&LEVEL_WATCH, LEVEL_PATH)) {
+            TraceLog(LOG_INFO, "LEVEL: watching %s", LEVEL_PATH);
+        } else {
+            TraceLog(LOG_WARNING, "LEVEL: can't watch %s", LEVEL_PATH);
+        }
+    }
 
-    CAMERA.target = Vector2Add(CAMERA.target, position_step);
+    // the first frame has a snapshot to draw
+    update_sim_input();
+    publish_snapshot(get_camera_view_rect());
+    start_sim_thread();
 }
 
 void update(void) {
-    update_reset();
-    update_player();
-    update_obstacles();
-
-    update_player_collisions();
-    update_camera();
+    update_frame();
 }
 
 void draw(void) {
+    PROFILE_ZONE("draw");
+    {
+        PROFILE_ZONE("update_hud_layer");
+        update_hud_layer(SNAPSHOT);
+    }
+
     BeginDrawing();
     ClearBackground(BACKGROUND_COLOR);
 
-    BeginMode2D(CAMERA);
-    draw_player();
-    draw_obstacles();
-    EndMode2D();
+    {
+        PROFILE_ZONE("draw_world");
+        BeginMode2D(CAMERA);
+        draw_agents(SNAPSHOT, SNAPSHOT_ALPHA);
+        draw_obstacles(SNAPSHOT, SNAPSHOT_ALPHA);
+        EndMode2D();
+    }
 
-    draw_ui();
+    draw_hud_layer();
+    draw_culling_counters(SNAPSHOT);
+    draw_profile_overlay();
 
+    // swaps the buffers and waits out the frame cap
+    PROFILE_ZONE("end_drawing");
     EndDrawing();
 }
 
 void unload(void) {
+    stop_sim_thread();
+    if (REPLAY.diverged_tick) {
+        TraceLog(
+            LOG_WARNING,
+            "REPLAY: diverged at tick %llu",
+            (unsigned long long)REPLAY.diverged_tick
+        );
+    }
+    unload_obstacles();
+    unload_hud_layer();
+    free_snapshots();
+    unwatch_level(&LEVEL_WATCH);
+    stop_replay();
+    free_tower();
+    free_job_pool();
+    unload_profiler();
     CloseWindow();
 }
 
-int main(void) {
+// usage: platforms [--tick-rate 60|120|240] [--fps N (0 = uncapped)] [--seed S]
+//                  [--level FILE] [--record FILE | --play FILE]
+//                  [--profile FILE] [--trace FILE]
+void parse_args(int argc, char **argv) {
+    for (int i = 1; i < argc - 1; ++i) {
+        if (strcmp(argv[i], "--tick-rate") == 0) {
+            TICK_RATE = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--fps") == 0) {
+            TARGET_FPS = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0) {
+            SEED = strtoull(argv[++i], NULL, 10);
+            IS_SEED_SET = true;
+        } else if (strcmp(argv[i], "--level") == 0) {
+            LEVEL_PATH = argv[++i];
+        } else if (strcmp(argv[i], "--record") == 0) {
+            RECORD_PATH = argv[++i];
+        } else if (strcmp(argv[i], "--play") == 0) {
+            PLAY_PATH = argv[++i];
+        } else if (strcmp(argv[i], "--profile") == 0) {
+            PROFILE_PATH = argv[++i];
+        } else if (strcmp(argv[i], "--trace") == 0) {
+            TRACE_PATH = argv[++i];
+        }
+    }
+
+    if (TICK_RATE <= 0) TICK_RATE = DEFAULT_TICK_RATE;
+    if (TARGET_FPS < 0) TARGET_FPS = DEFAULT_TARGET_FPS;
+}
+
+int main(int argc, char **argv) {
+    parse_args(argc, argv);
     load();
 
     while (!WindowShouldClose()) {
@@ -0,0 +1,217 @@
+#include "profiler.h"
+
+#ifdef PROFILE
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// the zones are added, never removed: a new zone is filled in, then linked
+// after its last sibling, so the lookups walk the links with no lock
+typedef struct ProfileZone {
+    const char *name;
+    int parent;
+    int depth;
+
+    // zone indices, 0 (the root, never a child) ends the list
+    _Atomic int first_child;
+    _Atomic int next_sibling;
+
+    _Atomic uint64_t n_calls;
+    // ring of the last durations, in clock ticks
+    _Atomic uint64_t samples[PROFILE_N_SAMPLES];
+} ProfileZone;
+
+typedef struct Profiler {
+    double us_per_tick;
+    // guards adding zones
+    pthread_mutex_t mutex;
+    _Atomic int n_zones;
+    ProfileZone zones[PROFILE_MAX_ZONES];
+} Profiler;
+
+static Profiler PROFILER = {
+    .us_per_tick = 1e-3,
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .n_zones = 1,
+    .zones = {[PROFILE_ROOT_ZONE] = {.name = "", .depth = -1}},
+};
+
+static _Thread_local int PROFILE_THREAD_ZONE = PROFILE_ROOT_ZONE;
+
+static double get_profile_time(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+void init_profiler(void) {
+    double time = get_profile_time();
+    uint64_t ticks = read_profile_clock();
+    struct timespec ts = {.tv_nsec = 20000000};
+    nanosleep(&ts, NULL);
+    double elapsed = get_profile_time() - time;
+    uint64_t n_ticks = read_profile_clock() - ticks;
+    if (n_ticks > 0) PROFILER.us_per_tick = 1e6 * elapsed / n_ticks;
+}
+
+double get_profile_us_per_tick(void) {
+    return PROFILER.us_per_tick;
+}
+
+// -----------------------------------------------------------------------
+// zones
+static int load_profile_link(_Atomic int *link) {
+    return atomic_load_explicit(link, memory_order_acquire);
+}
+
+static int find_profile_zone(int parent, const char *name) {
+    int zone = load_profile_link(&PROFILER.zones[parent].first_child);
+    while (zone != PROFILE_ROOT_ZONE) {
+        ProfileZone *child = &PROFILER.zones[zone];
+        if (child->name == name || strcmp(child->name, name) == 0) return zone;
+        zone = load_profile_link(&child->next_sibling);
+    }
+    return -1;
+}
+
+static int add_profile_zone(int parent, const char *name) {
+    pthread_mutex_lock(&PROFILER.mutex);
+    // another thread may have added it since the lookup
+    int zone = find_profile_zone(parent, name);
+    int n_zones = atomic_load(&PROFILER.n_zones);
+    if (zone == -1 && n_zones < PROFILE_MAX_ZONES) {
+        zone = n_zones;
+        ProfileZone *new_zone = &PROFILER.zones[zone];
+        new_zone->name = name;
+        new_zone->parent = parent;
+        new_zone->depth = PROFILER.zones[parent].depth + 1;
+        atomic_store(&PROFILER.n_zones, n_zones + 1);
+
+        _Atomic int *link = &PROFILER.zones[parent].first_child;
+        while (atomic_load(link) != PROFILE_ROOT_ZONE) {
+            link = &PROFILER.zones[atomic_load(link)].next_sibling;
+        }
+        atomic_store_explicit(link, zone, memory_order_release);
+    }
+    pthread_mutex_unlock(&PROFILER.mutex);
+    return zone;
+}
+
+ProfileScope begin_profile_scope(const char *name) {
+    int parent = PROFILE_THREAD_ZONE;
+    int zone = find_profile_zone(parent, name);
+    if (zone == -1) zone = add_profile_zone(parent, name);
+    if (zone != -1) PROFILE_THREAD_ZONE = zone;
+    return (ProfileScope){.zone = zone, .parent = parent, .start = read_profile_clock()};
+}
+
+void end_profile_scope(ProfileScope *scope) {
+    uint64_t n_ticks = read_profile_clock() - scope->start;
+    if (scope->zone == -1) return;
+
+    ProfileZone *zone = &PROFILER.zones[scope->zone];
+    record_trace_zone(zone->name, scope->start, n_ticks);
+    uint64_t n_calls = atomic_fetch_add_explicit(&zone->n_calls, 1, memory_order_relaxed);
+    atomic_store_explicit(
+        &zone->samples[n_calls % PROFILE_N_SAMPLES], n_ticks, memory_order_relaxed
+    );
+    PROFILE_THREAD_ZONE = scope->parent;
+}
+
+int get_profile_zone(void) {
+    return PROFILE_THREAD_ZONE;
+}
+
+void set_profile_zone(int zone) {
+    PROFILE_THREAD_ZONE = zone;
+}
+
+// -----------------------------------------------------------------------
+// stats
+static int compare_profile_samples(const void *a, const void *b) {
+    uint64_t sample_a = *(const uint64_t *)a;
+    uint64_t sample_b = *(const uint64_t *)b;
+    return (sample_a > sample_b) - (sample_a < sample_b);
+}
+
+static ProfileStats get_profile_zone_stats(int zone_idx) {
+    ProfileZone *zone = &PROFILER.zones[zone_idx];
+    ProfileStats stats = {
+        .name = zone->name,
+        .zone = zone_idx,
+        .parent = zone->parent,
+        .depth = zone->depth,
+        .n_calls = atomic_load_explicit(&zone->n_calls, memory_order_relaxed),
+    };
+
+    // the ring may be written meanwhile, the stats mix in a newer sample
+    // or two then
+    uint64_t samples[PROFILE_N_SAMPLES];
+    int n = stats.n_calls < PROFILE_N_SAMPLES ? stats.n_calls : PROFILE_N_SAMPLES;
+    if (n == 0) return stats;
+    uint64_t sum = 0;
+    for (int i = 0; i < n; ++i) {
+        samples[i] = atomic_load_explicit(&zone->samples[i], memory_order_relaxed);
+        sum += samples[i];
+    }
+    qsort(samples, n, sizeof(uint64_t), compare_profile_samples);
+
+    int p99 = (99 * n + 99) / 100 - 1;
+    stats.min_us = samples[0] * PROFILER.us_per_tick;
+    stats.avg_us = (double)sum / n * PROFILER.us_per_tick;
+    stats.p99_us = samples[p99] * PROFILER.us_per_tick;
+    return stats;
+}
+
+static int get_profile_subtree_stats(int parent, ProfileStats *out_stats, int n_stats) {
+    int zone = load_profile_link(&PROFILER.zones[parent].first_child);
+    while (zone != PROFILE_ROOT_ZONE) {
+        out_stats[n_stats++] = get_profile_zone_stats(zone);
+        n_stats = get_profile_subtree_stats(zone, out_stats, n_stats);
+        zone = load_profile_link(&PROFILER.zones[zone].next_sibling);
+    }
+    return n_stats;
+}
+
+int get_profile_stats(ProfileStats *out_stats) {
+    return get_profile_subtree_stats(PROFILE_ROOT_ZONE, out_stats, 0);
+}
+
+// -----------------------------------------------------------------------
+// csv
+bool write_profile_csv_header(FILE *file) {
+    return fprintf(file, "time,zone,depth,calls,min_us,avg_us,p99_us\n") > 0;
+}
+
+static void write_profile_zone_path(FILE *file, int zone) {
+    int parent = PROFILER.zones[zone].parent;
+    if (parent != PROFILE_ROOT_ZONE) {
+        write_profile_zone_path(file, parent);
+        fputc('/', file);
+    }
+    fputs(PROFILER.zones[zone].name, file);
+}
+
+bool write_profile_csv(FILE *file, double time) {
+    ProfileStats stats[PROFILE_MAX_ZONES];
+    int n_stats = get_profile_stats(stats);
+    for (int i = 0; i < n_stats; ++i) {
+        fprintf(file, "%.3f,", time);
+        write_profile_zone_path(file, stats[i].zone);
+        fprintf(
+            file,
+            ",%d,%llu,%.3f,%.3f,%.3f\n",
+            stats[i].depth,
+            (unsigned long long)stats[i].n_calls,
+            stats[i].min_us,
+            stats[i].avg_us,
+            stats[i].p99_us
+        );
+    }
+    return fflush(file) == 0;
+}
+
+#endif
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "trace.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// -----------------------------------------------------------------------
+// zone profiler
+// PROFILE_ZONE(name) times the rest of the enclosing block as a zone,
+// nested under the zone the thread is in. the zones form a tree shared by
+// all threads: a zone is its name under its parent, so a job run by the
+// pool continues under the zone that started the loop, whichever worker
+// runs it
+//
+// a zone keeps its last PROFILE_N_SAMPLES durations, read in TSC ticks,
+// for rolling min/avg/p99 stats, and is written to the trace while one
+// is recording (see ./src/trace.h), as PROFILE_COUNTER values are. it's
+// compiled in with -DPROFILE (make PROFILE=1), without it the macros are
+// empty and nothing is linked
+
+#define PROFILE_MAX_ZONES 128
+#define PROFILE_N_SAMPLES 256
+
+// parent of the top zones, the zone of a thread outside of any
+#define PROFILE_ROOT_ZONE 0
+
+typedef struct ProfileStats {
+    const char *name;
+    int zone;
+    int parent;
+    // 0 for the top zones
+    int depth;
+    uint64_t n_calls;
+    // over the last samples, in microseconds
+    double min_us;
+    double avg_us;
+    double p99_us;
+} ProfileStats;
+
+#ifdef PROFILE
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+static inline uint64_t read_profile_clock(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#elif defined(__aarch64__)
+    uint64_t ticks;
+    __asm__ volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+    return ticks;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+}
+
+typedef struct ProfileScope {
+    // -1 if the zone table is full
+    int zone;
+    int parent;
+    uint64_t start;
+} ProfileScope;
+
+// calibrates the clock, called once before the stats are read
+void init_profiler(void);
+double get_profile_us_per_tick(void);
+
+ProfileScope begin_profile_scope(const char *name);
+void end_profile_scope(ProfileScope *scope);
+
+// the zone of the thread, for a job to continue in on another thread
+int get_profile_zone(void);
+void set_profile_zone(int zone);
+
+// stats of every zone, parents before their children, returns the count
+int get_profile_stats(ProfileStats *out_stats);
+
+// writes the csv header, then a row per zone and dump, with the zone path
+bool write_profile_csv_header(FILE *file);
+bool write_profile_csv(FILE *file, double time);
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_ZONE(name)                                                          \
+    ProfileScope PROFILE_CONCAT(profile_scope_, __LINE__)                           \
+        __attribute__((cleanup(end_profile_scope))) = begin_profile_scope(name)
+#define PROFILE_GET_ZONE() get_profile_zone()
+#define PROFILE_SET_ZONE(zone) set_profile_zone(zone)
+#define PROFILE_COUNTER(name, value) record_trace_counter(name, value)
+#define PROFILE_THREAD_NAME(name) name_trace_thread(name)
+
+#else
+
+#define PROFILE_ZONE(name) ((void)0)
+#define PROFILE_GET_ZONE() PROFILE_ROOT_ZONE
+#define PROFILE_SET_ZONE(zone) ((void)(zone))
+#define PROFILE_COUNTER(name, value) ((void)0)
+#define PROFILE_THREAD_NAME(name) ((void)0)
+
+#endif
@@ -0,0 +1,236 @@
+#include "replay.h"
+
+#include "sim.h"
+#include <string.h>
+
+Replay REPLAY = {0};
+
+// -----------------------------------------------------------------------
+// io
+// fixed byte order, so a replay plays on any machine
+static void write_u8(uint8_t value) {
+    fputc(value, REPLAY.file);
+}
+
+static void write_u32(uint32_t value) {
+    uint8_t bytes[4];
+    for (int i = 0; i < 4; ++i) {
+        bytes[i] = value >> (8 * i);
+    }
+    fwrite(bytes, 1, sizeof(bytes), REPLAY.file);
+}
+
+static void write_u64(uint64_t value) {
+    write_u32((uint32_t)value);
+    write_u32((uint32_t)(value >> 32));
+}
+
+static void write_f32(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    write_u32(bits);
+}
+
+static bool read_u8(uint8_t *out_value) {
+    int c = fgetc(REPLAY.file);
+    if (c == EOF) return false;
+    *out_value = c;
+    return true;
+}
+
+static bool read_u32(uint32_t *out_value) {
+    uint8_t bytes[4];
+    if (fread(bytes, 1, sizeof(bytes), REPLAY.file) != sizeof(bytes)) return false;
+
+    uint32_t value = 0;
+    for (int i = 0; i < 4; ++i) {
+        value |= (uint32_t)bytes[i] << (8 * i);
+    }
+    *out_value = value;
+    return true;
+}
+
+static bool read_u64(uint64_t *out_value) {
+    uint32_t low, high;
+    if (!read_u32(&low) || !read_u32(&high)) return false;
+    *out_value = (uint64_t)high << 32 | low;
+    return true;
+}
+
+static bool read_f32(float *out_value) {
+    uint32_t bits;
+    if (!read_u32(&bits)) return false;
+    memcpy(out_value, &bits, sizeof(bits));
+    return true;
+}
+
+// -----------------------------------------------------------------------
+// playback
+// applies the events up to the next tick record and latches its inputs
+// returns false at the end of the file or on a broken record
+static bool read_events(void) {
+    for (;;) {
+        uint8_t tag;
+        if (!read_u8(&tag)) return false;
+
+        switch (tag) {
+            case REPLAY_LOAD: {
+                // the load happened between frames, the frame clock of the
+                // playback isn't reset
+                float accumulator = TICK_ACCUMULATOR;
+                load_game();
+                TICK_ACCUMULATOR = accumulator;
+            } break;
+            case REPLAY_SPAWN: {
+                Vector2 position;
+                if (!read_f32(&position.x) || !read_f32(&position.y)) return false;
+                spawn_agent(position);
+            } break;
+            case REPLAY_RESPAWN: {
+                uint32_t agent;
+                if (!read_u32(&agent) || agent >= (uint32_t)AGENTS.n) return false;
+                respawn_agent(agent);
+            } break;
+            case REPLAY_TICK: {
+                for (int i = 0; i < AGENTS.n; ++i) {
+                    uint8_t input;
+                    if (!read_u8(&input)) return false;
+                    AGENTS.input[i] = input;
+                }
+                return read_u32(&REPLAY.expected_hash);
+            }
+            default: return false;
+        }
+    }
+}
+
+// the events are applied right after the tick before them: nothing
+// happens in between, and the world is there to be drawn before the next
+// tick runs
+static void play_events(void) {
+    if (!read_events()) REPLAY.is_done = true;
+}
+
+// -----------------------------------------------------------------------
+// session
+bool start_recording(const char *path, uint64_t seed) {
+    stop_replay();
+
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) return false;
+
+    REPLAY = (Replay){
+        .mode = REPLAY_RECORDING,
+        .file = file,
+        .seed = seed,
+        .tick_rate = TICK_RATE,
+        .tower_memory_budget = TOWER.memory_budget,
+    };
+    write_u32(REPLAY_MAGIC);
+    write_u32(REPLAY_VERSION);
+    write_u64(seed);
+    write_u32(TICK_RATE);
+    write_u32(REPLAY.tower_memory_budget);
+
+    uint32_t level_path_length = LEVEL_PATH ? strlen(LEVEL_PATH) : 0;
+    write_u32(level_path_length);
+    fwrite(LEVEL_PATH, 1, level_path_length, file);
+
+    seed_random(seed);
+    return true;
+}
+
+bool start_playback(const char *path) {
+    stop_replay();
+
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) return false;
+
+    REPLAY = (Replay){.mode = REPLAY_PLAYING, .file = file};
+    uint32_t magic, version, tick_rate;
+    bool is_read = read_u32(&magic) && read_u32(&version) && read_u64(&REPLAY.seed)
+                   && read_u32(&tick_rate) && read_u32(&REPLAY.tower_memory_budget);
+    if (!is_read || magic != REPLAY_MAGIC || version != REPLAY_VERSION || tick_rate == 0) {
+        stop_replay();
+        return false;
+    }
+
+    uint32_t level_path_length;
+    if (!read_u32(&level_path_length) || level_path_length >= REPLAY_MAX_LEVEL_PATH_LENGTH
+        || fread(REPLAY.level_path, 1, level_path_length, file) != level_path_length) {
+        stop_replay();
+        return false;
+    }
+    REPLAY.level_path[level_path_length] = '\0';
+    LEVEL_PATH = level_path_length ? REPLAY.level_path : NULL;
+
+    REPLAY.tick_rate = tick_rate;
+    TICK_RATE = tick_rate;
+    TOWER.memory_budget = REPLAY.tower_memory_budget;
+    seed_random(REPLAY.seed);
+
+    // loads the level, so there's a world to show before the first tick
+    play_events();
+    return true;
+}
+
+void stop_replay(void) {
+    if (REPLAY.file) fclose(REPLAY.file);
+    REPLAY.file = NULL;
+    REPLAY.mode = REPLAY_OFF;
+}
+
+// -----------------------------------------------------------------------
+// events
+void record_load(void) {
+    if (REPLAY.mode != REPLAY_RECORDING) return;
+    write_u8(REPLAY_LOAD);
+}
+
+void record_spawn(Vector2 position) {
+    if (REPLAY.mode != REPLAY_RECORDING) return;
+    write_u8(REPLAY_SPAWN);
+    write_f32(position.x);
+    write_f32(position.y);
+}
+
+void record_respawn(int agent) {
+    if (REPLAY.mode != REPLAY_RECORDING) return;
+    write_u8(REPLAY_RESPAWN);
+    write_u32(agent);
+}
+
+// -----------------------------------------------------------------------
+// ticks
+bool begin_replay_tick(void) {
+    switch (REPLAY.mode) {
+        case REPLAY_RECORDING:
+            write_u8(REPLAY_TICK);
+            for (int i = 0; i < AGENTS.n; ++i) {
+                write_u8(AGENTS.input[i]);
+            }
+            break;
+        case REPLAY_PLAYING:
+            if (REPLAY.is_done) return false;
+            break;
+        default: break;
+    }
+    return true;
+}
+
+void end_replay_tick(void) {
+    switch (REPLAY.mode) {
+        case REPLAY_RECORDING:
+            write_u32(get_state_hash());
+            REPLAY.n_ticks += 1;
+            break;
+        case REPLAY_PLAYING:
+            REPLAY.n_ticks += 1;
+            if (REPLAY.diverged_tick == 0 && get_state_hash() != REPLAY.expected_hash) {
+                REPLAY.diverged_tick = REPLAY.n_ticks;
+            }
+            play_events();
+            break;
+        default: break;
+    }
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "raylib.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// -----------------------------------------------------------------------
+// replay
+// a session is reproduced from the world seed, the tick rate, the level
+// file (if any), the tower memory budget (it decides which chunks are
+// resident) and what the
+// host did between ticks: level loads, agent spawns and respawns and the
+// latched input of every agent. ticks carry a hash of the state after
+// them, so playback reports the first tick that diverged
+//
+// file layout (little-endian), a header then records up to the end:
+//   header: "PLRP", u32 version, u64 seed, u32 tick rate,
+//           u32 tower memory budget, u32 level path length, path bytes
+//           (empty for the tower)
+//   REPLAY_LOAD
+//   REPLAY_SPAWN, f32 x, f32 y
+//   REPLAY_RESPAWN, u32 agent
+//   REPLAY_TICK, u8 input per agent, u32 state hash
+// the events before a tick record happened before that tick
+
+#define REPLAY_MAGIC 0x50524c50u
+#define REPLAY_VERSION 3
+#define REPLAY_MAX_LEVEL_PATH_LENGTH 4096
+
+typedef enum ReplayTag {
+    REPLAY_LOAD = 1,
+    REPLAY_SPAWN = 2,
+    REPLAY_RESPAWN = 3,
+    REPLAY_TICK = 4,
+} ReplayTag;
+
+typedef enum ReplayMode {
+    REPLAY_OFF,
+    REPLAY_RECORDING,
+    REPLAY_PLAYING,
+} ReplayMode;
+
+typedef struct Replay {
+    ReplayMode mode;
+    FILE *file;
+
+    uint64_t seed;
+    int tick_rate;
+    uint32_t tower_memory_budget;
+    // LEVEL_PATH points here during a playback
+    char level_path[REPLAY_MAX_LEVEL_PATH_LENGTH];
+
+    // ticks recorded or played so far
+    uint64_t n_ticks;
+
+    // playback reached the end of the file (or a broken record)
+    bool is_done;
+
+    // hash the playback expects after the current tick
+    uint32_t expected_hash;
+
+    // first tick whose state hash didn't match the recording, 0 if none
+    // (ticks are counted from 1)
+    uint64_t diverged_tick;
+} Replay;
+
+extern Replay REPLAY;
+
+// seeds the world and records from here on, the host loads the level next
+// returns false if the file can't be created
+bool start_recording(const char *path, uint64_t seed);
+
+// seeds the world and sets the tick rate, the level file and the tower
+// budget from the file, the level is
+// loaded by the first tick
+// returns false if the file can't be read or isn't a replay
+bool start_playback(const char *path);
+
+void stop_replay(void);
+
+// called by the simulation for what it does on the host's behalf
+void record_load(void);
+void record_spawn(Vector2 position);
+void record_respawn(int agent);
+
+// around every tick, no-ops without a replay: writes or applies the
+// events and the inputs before it, and writes or checks the state hash
+// after it
+// begin_replay_tick returns false when the playback is done
+bool begin_replay_tick(void);
+void end_replay_tick(void);
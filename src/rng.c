@@ -0,0 +1,96 @@
+#include "rng.h"
+
+#include "kernels.h"
+
+// -----------------------------------------------------------------------
+// lcg
+static void step_rng(Rng *rng) {
+    rng->state = rng->state * RNG_MULTIPLIER + rng->inc;
+}
+
+// multiplier and increment of delta steps at once
+static void get_lcg_jump(
+    uint64_t delta, uint64_t inc, uint64_t *out_multiplier, uint64_t *out_inc
+) {
+    uint64_t multiplier = RNG_MULTIPLIER;
+    uint64_t jump_multiplier = 1;
+    uint64_t jump_inc = 0;
+    while (delta > 0) {
+        if (delta & 1) {
+            jump_multiplier *= multiplier;
+            jump_inc = jump_inc * multiplier + inc;
+        }
+        inc = (multiplier + 1) * inc;
+        multiplier *= multiplier;
+        delta >>= 1;
+    }
+    *out_multiplier = jump_multiplier;
+    *out_inc = jump_inc;
+}
+
+// -----------------------------------------------------------------------
+// streams
+Rng make_rng(uint64_t seed, uint64_t stream) {
+    Rng rng = {.state = 0, .inc = stream << 1 | 1};
+    step_rng(&rng);
+    rng.state += seed;
+    step_rng(&rng);
+    return rng;
+}
+
+void advance_rng(Rng *rng, uint64_t delta) {
+    uint64_t multiplier, inc;
+    get_lcg_jump(delta, rng->inc, &multiplier, &inc);
+    rng->state = rng->state * multiplier + inc;
+}
+
+uint32_t next_rng_u32(Rng *rng) {
+    uint64_t state = rng->state;
+    step_rng(rng);
+    return get_pcg32_output(state);
+}
+
+uint64_t next_rng_u64(Rng *rng) {
+    uint64_t high = next_rng_u32(rng);
+    return high << 32 | next_rng_u32(rng);
+}
+
+float next_rng_float(Rng *rng) {
+    return get_rng_float(next_rng_u32(rng));
+}
+
+float next_rng_float_min_max(Rng *rng, float min, float max) {
+    return min + next_rng_float(rng) * (max - min);
+}
+
+// -----------------------------------------------------------------------
+// batch
+void fill_rng_floats(Rng *rng, float *out, int n) {
+    int n_blocks = n / RNG_N_LANES;
+    if (n_blocks > 0) {
+        uint64_t lanes[RNG_N_LANES];
+        for (int i = 0; i < RNG_N_LANES; ++i) {
+            lanes[i] = rng->state;
+            step_rng(rng);
+        }
+
+        // every lane jumps over the other lanes' draws
+        uint64_t multiplier, inc;
+        get_lcg_jump(RNG_N_LANES, rng->inc, &multiplier, &inc);
+        KERNELS->fill_rng_lanes(lanes, multiplier, inc, out, n_blocks);
+
+        // the first lane ended where the stream continues
+        rng->state = lanes[0];
+    }
+
+    for (int i = n_blocks * RNG_N_LANES; i < n; ++i) {
+        out[i] = next_rng_float(rng);
+    }
+}
+
+void fill_rng_floats_min_max(Rng *rng, float *out, int n, float min, float max) {
+    fill_rng_floats(rng, out, n);
+    for (int i = 0; i < n; ++i) {
+        out[i] = min + out[i] * (max - min);
+    }
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdint.h>
+
+// -----------------------------------------------------------------------
+// random number streams
+// PCG32 (64-bit LCG state, xorshift + random rotation output): small,
+// seedable and built from integer ops only, so a stream gives the same
+// values on every platform. a generator (or thread) takes its own stream,
+// streams with the same seed and different stream ids are independent
+//
+// the batch fill runs RNG_N_LANES lanes, each leapfrogging RNG_N_LANES
+// steps, so it writes exactly the values single draws would
+
+#define RNG_N_LANES 8
+
+typedef struct Rng {
+    uint64_t state;
+    // odd, selects the stream
+    uint64_t inc;
+} Rng;
+
+#define RNG_MULTIPLIER 6364136223846793005ull
+
+static inline uint32_t get_pcg32_output(uint64_t state) {
+    uint32_t xorshifted = ((state >> 18) ^ state) >> 27;
+    uint32_t rot = state >> 59;
+    return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+}
+
+// uniform in [0, 1), 24 random bits, exact in float
+static inline float get_rng_float(uint32_t bits) {
+    return (bits >> 8) * (1.0f / 16777216.0f);
+}
+
+Rng make_rng(uint64_t seed, uint64_t stream);
+
+// moves the stream by delta draws in O(log delta)
+void advance_rng(Rng *rng, uint64_t delta);
+
+uint32_t next_rng_u32(Rng *rng);
+uint64_t next_rng_u64(Rng *rng);
+float next_rng_float(Rng *rng);
+float next_rng_float_min_max(Rng *rng, float min, float max);
+
+// out[i] = next_rng_float(rng) for n draws
+void fill_rng_floats(Rng *rng, float *out, int n);
+
+// out[i] = min + next_rng_float(rng) * (max - min) for n draws
+void fill_rng_floats_min_max(Rng *rng, float *out, int n, float min, float max);
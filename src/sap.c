@@ -0,0 +1,341 @@
+#include "sap.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// more unsorted endpoints than this (e.g. after a level load) are sorted
+// from scratch, insertion sort is quadratic for random order
+#define SAP_MAX_N_INCREMENTAL_ENDPOINTS 64
+
+#define SAP_DEFAULT_AXIS 1
+
+// data of the endpoints of removed proxies
+#define SAP_DEAD_ENDPOINT UINT32_MAX
+
+// -----------------------------------------------------------------------
+// utils
+static float get_rect_bound(Rectangle rect, int axis, int is_max) {
+    float min = axis == 0 ? rect.x : rect.y;
+    float size = axis == 0 ? rect.width : rect.height;
+    return is_max ? min + size : min;
+}
+
+static bool is_axis_overlap(Rectangle a, Rectangle b, int axis) {
+    return get_rect_bound(a, axis, 0) < get_rect_bound(b, axis, 1)
+           && get_rect_bound(b, axis, 0) < get_rect_bound(a, axis, 1);
+}
+
+static int get_endpoint_id(SapEndpoint endpoint) {
+    return endpoint.data >> 1;
+}
+
+static int get_endpoint_is_max(SapEndpoint endpoint) {
+    return endpoint.data & 1;
+}
+
+// -----------------------------------------------------------------------
+// overlaps
+static bool has_overlap(SapProxy *proxy, int id) {
+    for (int i = 0; i < proxy->n_overlaps; ++i) {
+        if (proxy->overlaps[i] == id) return true;
+    }
+    return false;
+}
+
+static void push_overlap(SapProxy *proxy, int id) {
+    if (proxy->n_overlaps == proxy->overlaps_capacity) {
+        int capacity = proxy->overlaps_capacity ? 2 * proxy->overlaps_capacity : 8;
+        proxy->overlaps = realloc(proxy->overlaps, capacity * sizeof(int));
+        proxy->overlaps_capacity = capacity;
+    }
+    proxy->overlaps[proxy->n_overlaps++] = id;
+}
+
+static bool remove_overlap(SapProxy *proxy, int id) {
+    for (int i = 0; i < proxy->n_overlaps; ++i) {
+        if (proxy->overlaps[i] != id) continue;
+        proxy->overlaps[i] = proxy->overlaps[--proxy->n_overlaps];
+        return true;
+    }
+    return false;
+}
+
+static void add_overlap(Sap *sap, int a_id, int b_id) {
+    SapProxy *a = &sap->proxies[a_id];
+    SapProxy *b = &sap->proxies[b_id];
+    if (a->is_reporting == b->is_reporting) return;
+
+    // overlap lists are symmetric, so checking one side is enough
+    if (has_overlap(a, b_id)) return;
+
+    push_overlap(a, b_id);
+    push_overlap(b, a_id);
+}
+
+static void remove_overlap_pair(Sap *sap, int a_id, int b_id) {
+    SapProxy *a = &sap->proxies[a_id];
+    SapProxy *b = &sap->proxies[b_id];
+    if (a->is_reporting == b->is_reporting) return;
+
+    if (remove_overlap(a, b_id)) remove_overlap(b, a_id);
+}
+
+// a min endpoint passing a max one to the left may start an overlap,
+// a max passing a min ends it
+static void handle_endpoint_swap(Sap *sap, SapEndpoint moving, SapEndpoint passed) {
+    int a_id = get_endpoint_id(moving);
+    int b_id = get_endpoint_id(passed);
+    int is_max = get_endpoint_is_max(moving);
+    if (a_id == b_id || is_max == get_endpoint_is_max(passed)) return;
+
+    if (is_max) {
+        remove_overlap_pair(sap, a_id, b_id);
+    } else {
+        // the whole proxy may have jumped over the other one, then its max
+        // endpoint passes the other min later in this sort
+        Rectangle a_rect = sap->proxies[a_id].rect;
+        Rectangle b_rect = sap->proxies[b_id].rect;
+        if (is_axis_overlap(a_rect, b_rect, sap->axis)) add_overlap(sap, a_id, b_id);
+    }
+}
+
+// -----------------------------------------------------------------------
+// sorting
+static void set_endpoint(Sap *sap, int idx, SapEndpoint endpoint) {
+    sap->endpoints[idx] = endpoint;
+    SapProxy *proxy = &sap->proxies[get_endpoint_id(endpoint)];
+    proxy->endpoints[get_endpoint_is_max(endpoint)] = idx;
+}
+
+// keeps the live endpoints in order, the sorted prefix shrinks by the dead
+// ones it held
+static void compact_endpoints(Sap *sap) {
+    int n = 0;
+    int n_sorted = 0;
+    for (int i = 0; i < sap->n_endpoints; ++i) {
+        SapEndpoint endpoint = sap->endpoints[i];
+        if (endpoint.data == SAP_DEAD_ENDPOINT) continue;
+
+        if (n != i) set_endpoint(sap, n, endpoint);
+        if (i < sap->n_sorted_endpoints) n_sorted += 1;
+        n += 1;
+    }
+    sap->n_endpoints = n;
+    sap->n_sorted_endpoints = n_sorted;
+    sap->n_dead_endpoints = 0;
+}
+
+static void insertion_sort(Sap *sap) {
+    SapEndpoint *endpoints = sap->endpoints;
+    for (int i = 1; i < sap->n_endpoints; ++i) {
+        SapEndpoint key = endpoints[i];
+        int j = i - 1;
+        while (j >= 0 && endpoints[j].value > key.value) {
+            handle_endpoint_swap(sap, key, endpoints[j]);
+            set_endpoint(sap, j + 1, endpoints[j]);
+            j -= 1;
+        }
+        if (j + 1 != i) set_endpoint(sap, j + 1, key);
+    }
+}
+
+static int compare_endpoints(const void *a, const void *b) {
+    const SapEndpoint *ea = a;
+    const SapEndpoint *eb = b;
+    if (ea->value < eb->value) return -1;
+    if (ea->value > eb->value) return 1;
+
+    // min before max on ties, so an empty proxy stays ordered
+    return (int)(ea->data & 1) - (int)(eb->data & 1);
+}
+
+// the axis along which the proxies are spread the most overlaps the least
+static int choose_axis(Sap *sap) {
+    double sum[2] = {0.0, 0.0};
+    double sum_sq[2] = {0.0, 0.0};
+    int n = 0;
+    for (int id = 0; id < sap->n_proxies; ++id) {
+        SapProxy *proxy = &sap->proxies[id];
+        if (!proxy->is_inserted) continue;
+
+        for (int axis = 0; axis < 2; ++axis) {
+            double center = 0.5
+                            * (get_rect_bound(proxy->rect, axis, 0)
+                               + get_rect_bound(proxy->rect, axis, 1));
+            sum[axis] += center;
+            sum_sq[axis] += center * center;
+        }
+        n += 1;
+    }
+    if (n == 0) return SAP_DEFAULT_AXIS;
+
+    double var_x = sum_sq[0] / n - (sum[0] / n) * (sum[0] / n);
+    double var_y = sum_sq[1] / n - (sum[1] / n) * (sum[1] / n);
+    return var_x > var_y ? 0 : 1;
+}
+
+// sorts from scratch, then sweeps the endpoints: a proxy overlaps the ones
+// of the other kind still open at its min endpoint. the pairs follow the
+// endpoint order, as the swaps of the incremental sort keep them
+static void rebuild_sap(Sap *sap) {
+    sap->axis = choose_axis(sap);
+    for (int i = 0; i < sap->n_endpoints; ++i) {
+        SapEndpoint *endpoint = &sap->endpoints[i];
+        Rectangle rect = sap->proxies[get_endpoint_id(*endpoint)].rect;
+        endpoint->value = get_rect_bound(rect, sap->axis, get_endpoint_is_max(*endpoint));
+    }
+
+    qsort(sap->endpoints, sap->n_endpoints, sizeof(SapEndpoint), compare_endpoints);
+    for (int i = 0; i < sap->n_endpoints; ++i) {
+        set_endpoint(sap, i, sap->endpoints[i]);
+    }
+
+    for (int id = 0; id < sap->n_proxies; ++id) {
+        sap->proxies[id].n_overlaps = 0;
+    }
+
+    int *open_ids[2] = {sap->sweep_ids, sap->sweep_ids + sap->n_proxies};
+    int n_open[2] = {0, 0};
+    for (int i = 0; i < sap->n_endpoints; ++i) {
+        int id = get_endpoint_id(sap->endpoints[i]);
+        SapProxy *proxy = &sap->proxies[id];
+        int kind = proxy->is_reporting;
+
+        if (get_endpoint_is_max(sap->endpoints[i])) {
+            for (int j = 0; j < n_open[kind]; ++j) {
+                if (open_ids[kind][j] != id) continue;
+                open_ids[kind][j] = open_ids[kind][--n_open[kind]];
+                break;
+            }
+            continue;
+        }
+
+        for (int j = 0; j < n_open[!kind]; ++j) {
+            int other_id = open_ids[!kind][j];
+            push_overlap(proxy, other_id);
+            push_overlap(&sap->proxies[other_id], id);
+        }
+        open_ids[kind][n_open[kind]++] = id;
+    }
+}
+
+void sort_sap(Sap *sap) {
+    if (sap->n_dead_endpoints > 0) compact_endpoints(sap);
+
+    int n_unsorted = sap->n_endpoints - sap->n_sorted_endpoints;
+    if (n_unsorted > SAP_MAX_N_INCREMENTAL_ENDPOINTS) rebuild_sap(sap);
+    else insertion_sort(sap);
+    sap->n_sorted_endpoints = sap->n_endpoints;
+}
+
+// -----------------------------------------------------------------------
+// proxies
+void reset_sap(Sap *sap) {
+    sap->axis = SAP_DEFAULT_AXIS;
+    sap->n_endpoints = 0;
+    sap->n_sorted_endpoints = 0;
+    sap->n_dead_endpoints = 0;
+    for (int i = 0; i < sap->n_proxies; ++i) {
+        sap->proxies[i].is_inserted = false;
+        sap->proxies[i].n_overlaps = 0;
+    }
+}
+
+void free_sap(Sap *sap) {
+    for (int i = 0; i < sap->n_proxies; ++i) {
+        free(sap->proxies[i].overlaps);
+    }
+    free(sap->proxies);
+    free(sap->sweep_ids);
+    free(sap->endpoints);
+    *sap = (Sap){.axis = SAP_DEFAULT_AXIS};
+}
+
+static void reserve_sap(Sap *sap, int n_proxies, int n_endpoints) {
+    if (n_proxies > sap->n_proxies) {
+        int n = sap->n_proxies ? sap->n_proxies : 64;
+        while (n < n_proxies) n *= 2;
+
+        sap->proxies = realloc(sap->proxies, n * sizeof(SapProxy));
+        memset(sap->proxies + sap->n_proxies, 0, (n - sap->n_proxies) * sizeof(SapProxy));
+        sap->sweep_ids = realloc(sap->sweep_ids, 2 * n * sizeof(int));
+        sap->n_proxies = n;
+    }
+
+    if (n_endpoints > sap->endpoints_capacity) {
+        int n = sap->endpoints_capacity ? sap->endpoints_capacity : 128;
+        while (n < n_endpoints) n *= 2;
+
+        sap->endpoints = realloc(sap->endpoints, n * sizeof(SapEndpoint));
+        sap->endpoints_capacity = n;
+    }
+}
+
+bool is_sap_item_inserted(Sap *sap, int id) {
+    return id < sap->n_proxies && sap->proxies[id].is_inserted;
+}
+
+// the new endpoints are appended unsorted, overlaps appear on the next sort_sap
+void insert_sap_item(Sap *sap, int id, Rectangle rect, bool is_reporting) {
+    if (is_sap_item_inserted(sap, id)) remove_sap_item(sap, id);
+    reserve_sap(sap, id + 1, sap->n_endpoints + 2);
+
+    SapProxy *proxy = &sap->proxies[id];
+    proxy->rect = rect;
+    proxy->is_inserted = true;
+    proxy->is_reporting = is_reporting;
+    proxy->n_overlaps = 0;
+
+    for (int is_max = 0; is_max < 2; ++is_max) {
+        SapEndpoint endpoint = {
+            .value = get_rect_bound(rect, sap->axis, is_max),
+            .data = (uint32_t)id << 1 | is_max,
+        };
+        set_endpoint(sap, sap->n_endpoints + is_max, endpoint);
+    }
+    sap->n_endpoints += 2;
+}
+
+// only moves the endpoint values, the order is fixed by sort_sap
+void update_sap_item(Sap *sap, int id, Rectangle rect) {
+    SapProxy *proxy = &sap->proxies[id];
+    proxy->rect = rect;
+    for (int is_max = 0; is_max < 2; ++is_max) {
+        int idx = proxy->endpoints[is_max];
+        sap->endpoints[idx].value = get_rect_bound(rect, sap->axis, is_max);
+    }
+}
+
+// drops the proxy's overlaps and marks its endpoints dead, the next
+// sort_sap compacts them out, so a batch of removals costs one pass
+void remove_sap_item(Sap *sap, int id) {
+    if (!is_sap_item_inserted(sap, id)) return;
+
+    SapProxy *proxy = &sap->proxies[id];
+    while (proxy->n_overlaps > 0) {
+        remove_overlap_pair(sap, id, proxy->overlaps[0]);
+    }
+    for (int is_max = 0; is_max < 2; ++is_max) {
+        sap->endpoints[proxy->endpoints[is_max]].data = SAP_DEAD_ENDPOINT;
+    }
+    proxy->is_inserted = false;
+    sap->n_dead_endpoints += 2;
+}
+
+int query_sap_pairs(Sap *sap, int id, int *out_ids, int max_n_ids) {
+    if (!is_sap_item_inserted(sap, id)) return 0;
+
+    SapProxy *proxy = &sap->proxies[id];
+    int n_ids = 0;
+    for (int i = 0; i < proxy->n_overlaps && n_ids < max_n_ids; ++i) {
+        // the sweep axis is checked again: an overlap that ends by the
+        // endpoints becoming equal is only dropped once they swap
+        int other_id = proxy->overlaps[i];
+        Rectangle other_rect = sap->proxies[other_id].rect;
+        if (!is_axis_overlap(proxy->rect, other_rect, 0)) continue;
+        if (!is_axis_overlap(proxy->rect, other_rect, 1)) continue;
+        out_ids[n_ids++] = other_id;
+    }
+
+    return n_ids;
+}
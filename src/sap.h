@@ -0,0 +1,81 @@
+#pragma once
+
+#include "raylib.h"
+#include <stdint.h>
+
+// -----------------------------------------------------------------------
+// sweep and prune
+// proxies are rects identified by a caller-owned id (index into the
+// caller's array); endpoints on the sweep axis stay sorted between updates
+// and are re-sorted with insertion sort, which is near O(N) for coherent
+// motion. overlaps on the sweep axis are found from endpoint swaps and
+// persist across updates, full rects are checked when pairs are queried.
+// removed proxies leave dead endpoints behind, the next sort compacts them
+// in one pass
+//
+// only one axis is kept sorted: platforms sweeping across a shared range
+// (every platform of a tower spans the same x range) would swap O(N^2)
+// endpoints per update on that axis. the axis with the larger spread of
+// proxy centers is chosen when the endpoints are sorted from scratch
+
+typedef struct SapEndpoint {
+    float value;
+
+    // proxy id << 1 | is_max
+    uint32_t data;
+} SapEndpoint;
+
+typedef struct SapProxy {
+    Rectangle rect;
+
+    // endpoint indices by is_max
+    int endpoints[2];
+
+    bool is_inserted;
+
+    // overlaps are tracked only between a reporting and a non-reporting
+    // proxy (e.g. agents and obstacles, never agents with each other)
+    bool is_reporting;
+
+    // ids of the proxies overlapping this one on the sweep axis, kept on
+    // both sides so a removal drops its pairs without a sort
+    int n_overlaps;
+    int overlaps_capacity;
+    int *overlaps;
+} SapProxy;
+
+typedef struct Sap {
+    // 0: x, 1: y
+    int axis;
+
+    int n_endpoints;
+    int n_sorted_endpoints;
+    // left by remove_sap_item until the next sort_sap
+    int n_dead_endpoints;
+    int endpoints_capacity;
+    SapEndpoint *endpoints;
+
+    // indexed by proxy id
+    int n_proxies;
+    SapProxy *proxies;
+
+    // proxies open at a point of the rebuild sweep, by is_reporting
+    int *sweep_ids;
+} Sap;
+
+void reset_sap(Sap *sap);
+void free_sap(Sap *sap);
+
+void insert_sap_item(Sap *sap, int id, Rectangle rect, bool is_reporting);
+void update_sap_item(Sap *sap, int id, Rectangle rect);
+void remove_sap_item(Sap *sap, int id);
+bool is_sap_item_inserted(Sap *sap, int id);
+
+// drops the dead endpoints, re-sorts the rest after the updates and
+// refreshes the overlaps
+void sort_sap(Sap *sap);
+
+// writes ids of the proxies overlapping the reporting proxy as of the last
+// sort_sap into out_ids
+// returns the number of ids written (at most max_n_ids)
+int query_sap_pairs(Sap *sap, int id, int *out_ids, int max_n_ids);
@@ -0,0 +1,1577 @@
+#include "sim.h"
+#include "profiler.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// the simulation is linked without raylib, so raymath must be self-contained
+#define RAYMATH_STATIC_INLINE
+#include "raymath.h"
+
+SimHost SIM_HOST = {0};
+
+Agents AGENTS = {0};
+
+Obstacles OBSTACLES = {.free_slot = -1};
+StaticObstacles STATIC_OBSTACLES = {0};
+StaticBvh STATIC_OBSTACLES_BVH = {0};
+
+Broadphase BROADPHASE = BROADPHASE_BVH;
+Grid OBSTACLES_GRID = {0};
+Bvh OBSTACLES_BVH = {.root = BVH_NULL_NODE, .free_node = BVH_NULL_NODE};
+Sap OBSTACLES_SAP = {.axis = 1};
+
+Contacts CONTACTS = {0};
+
+// per-worker scratch of the collision pass
+typedef struct Candidates {
+    int capacity;
+
+    // static and dynamic obstacles found by the queries
+    int *static_ids;
+    int *ids;
+
+    // candidate rects gathered for the batch mtv kernel
+    float *x;
+    float *y;
+    float *width;
+    float *height;
+    float *mtv_y;
+
+    // ground contacts of the agents the worker resolved, merged into CONTACTS
+    Contacts contacts;
+    // candidates the worker tested, summed into N_COLLISION_TESTS
+    int n_tests;
+} Candidates;
+
+static int N_CANDIDATES;
+static Candidates *CANDIDATES;
+
+// platform position steps of the last move_obstacles
+typedef struct Steps {
+    float *x;
+    float *y;
+} Steps;
+
+static Steps STEPS;
+
+// ids written by the raycast queries, the lod pass and the static index
+// build
+static int *QUERY_IDS;
+
+// obstacles the lod pass found near an agent
+static bool *IS_NEAR_AGENT;
+
+const char *LEVEL_PATH = NULL;
+
+// platforms of the loaded level file by their index in it, reload_level
+// patches them through the handles
+typedef struct LevelPlatforms {
+    // the level is the file, not the tower
+    bool is_loaded;
+    int n;
+    int capacity;
+    ObstacleHandle *handles;
+} LevelPlatforms;
+
+static LevelPlatforms LEVEL_PLATFORMS;
+
+int TICK_RATE = DEFAULT_TICK_RATE;
+float TICK_ACCUMULATOR = 0.0;
+uint64_t N_TICKS = 0;
+int N_COLLISION_TESTS = 0;
+
+// world randomness, owned by the simulation so a seed reproduces it on
+// every host; each level load draws the seed of the level's own streams
+static Rng WORLD_RNG = {.inc = 1};
+
+// -----------------------------------------------------------------------
+// utils
+void seed_random(uint64_t seed) {
+    WORLD_RNG = make_rng(seed, RNG_STREAM_WORLD);
+}
+
+// returns float uniform value from 0 to 1
+float randf(void) {
+    return next_rng_float(&WORLD_RNG);
+}
+
+// returns float uniform value from min to max
+float randf_min_max(float min, float max) {
+    float p = randf();
+    return min + p * (max - min);
+}
+
+// -----------------------------------------------------------------------
+// broadphase
+const char *get_broadphase_name(Broadphase broadphase) {
+    switch (broadphase) {
+        case BROADPHASE_LINEAR: return "linear";
+        case BROADPHASE_GRID: return "grid";
+        case BROADPHASE_BVH: return "bvh";
+        case BROADPHASE_SAP: return "sap";
+        default: break;
+    }
+    return "unknown";
+}
+
+// agents and obstacles share the sweep and prune id space
+static int get_sap_obstacle_id(int idx) {
+    return 2 * idx + 1;
+}
+
+static int get_sap_agent_id(int idx) {
+    return 2 * idx;
+}
+
+static void insert_obstacle_index(int idx) {
+    Rectangle rect = get_obstacle_index_rect(idx);
+    switch (BROADPHASE) {
+        case BROADPHASE_GRID: insert_grid_item(&OBSTACLES_GRID, idx, rect); break;
+        case BROADPHASE_BVH: insert_bvh_item(&OBSTACLES_BVH, idx, rect); break;
+        case BROADPHASE_SAP:
+            insert_sap_item(&OBSTACLES_SAP, get_sap_obstacle_id(idx), rect, false);
+            break;
+        default: break;
+    }
+}
+
+// indexes the obstacles first to first + n - 1 at once
+static void insert_obstacle_indices(int first, int n) {
+    if (BROADPHASE != BROADPHASE_BVH) {
+        for (int i = first; i < first + n; ++i) {
+            insert_obstacle_index(i);
+        }
+        return;
+    }
+
+    float *rects = malloc(4 * n * sizeof(float));
+    for (int i = 0; i < n; ++i) {
+        Rectangle rect = get_obstacle_index_rect(first + i);
+        rects[i] = rect.x;
+        rects[n + i] = rect.y;
+        rects[2 * n + i] = rect.width;
+        rects[3 * n + i] = rect.height;
+    }
+    insert_bvh_items(
+        &OBSTACLES_BVH, first, n, rects, rects + n, rects + 2 * n, rects + 3 * n
+    );
+    free(rects);
+}
+
+static void update_obstacle_index(int idx) {
+    Rectangle rect = get_obstacle_index_rect(idx);
+    switch (BROADPHASE) {
+        case BROADPHASE_GRID: update_grid_item(&OBSTACLES_GRID, idx, rect); break;
+        case BROADPHASE_BVH: update_bvh_item(&OBSTACLES_BVH, idx, rect); break;
+        case BROADPHASE_SAP:
+            update_sap_item(&OBSTACLES_SAP, get_sap_obstacle_id(idx), rect);
+            break;
+        default: break;
+    }
+}
+
+static void remove_obstacle_index(int idx) {
+    switch (BROADPHASE) {
+        case BROADPHASE_GRID: remove_grid_item(&OBSTACLES_GRID, idx); break;
+        case BROADPHASE_BVH: remove_bvh_item(&OBSTACLES_BVH, idx); break;
+        case BROADPHASE_SAP:
+            remove_sap_item(&OBSTACLES_SAP, get_sap_obstacle_id(idx));
+            break;
+        default: break;
+    }
+}
+
+// writes indices of the obstacles that may overlap the rect into out_ids
+// (which must fit OBSTACLES.n) and returns their number
+int query_obstacles(Rectangle rect, int *out_ids) {
+    switch (BROADPHASE) {
+        case BROADPHASE_GRID:
+            return query_grid(&OBSTACLES_GRID, rect, out_ids, OBSTACLES.n);
+        case BROADPHASE_BVH:
+            return query_bvh(&OBSTACLES_BVH, rect, out_ids, OBSTACLES.n);
+        default: break;
+    }
+
+    for (int i = 0; i < OBSTACLES.n; ++i) {
+        out_ids[i] = i;
+    }
+    return OBSTACLES.n;
+}
+
+// sweep and prune answers pair queries only, so the agents are proxies
+// and their candidates are the pairs they're in; the agent proxies are
+// moved all at once and sorted once per collision pass
+static void update_agents_sap(void) {
+    for (int i = 0; i < AGENTS.n; ++i) {
+        int id = get_sap_agent_id(i);
+        Rectangle rect = get_agent_rect(i);
+        if (is_sap_item_inserted(&OBSTACLES_SAP, id)) {
+            update_sap_item(&OBSTACLES_SAP, id, rect);
+        } else {
+            insert_sap_item(&OBSTACLES_SAP, id, rect, true);
+        }
+    }
+    sort_sap(&OBSTACLES_SAP);
+}
+
+static int query_agent_obstacles(int agent, Rectangle rect, int *out_ids) {
+    if (BROADPHASE != BROADPHASE_SAP) return query_obstacles(rect, out_ids);
+
+    int id = get_sap_agent_id(agent);
+    int n_ids = query_sap_pairs(&OBSTACLES_SAP, id, out_ids, OBSTACLES.n);
+    for (int i = 0; i < n_ids; ++i) {
+        out_ids[i] = (out_ids[i] - 1) / 2;
+    }
+    return n_ids;
+}
+
+typedef struct RaycastHit {
+    Vector2 start;
+    Vector2 end;
+    // which set the clipped ids are from
+    bool is_static_pass;
+    bool is_static;
+    int idx;
+    float fraction;
+} RaycastHit;
+
+// the tree walks clip by their own hits only, the closest one of the
+// other set bounds them too
+static float clip_raycast_hit(void *user, int idx, float max_fraction) {
+    RaycastHit *hit = user;
+    max_fraction = fminf(max_fraction, hit->fraction);
+    Rectangle rect;
+    if (hit->is_static_pass) rect = get_static_obstacle_rect(idx);
+    else rect = get_obstacle_rect(idx);
+
+    float fraction;
+    if (!raycast_aabb(get_rect_aabb(rect), hit->start, hit->end, max_fraction, &fraction)) {
+        return max_fraction;
+    }
+
+    hit->is_static = hit->is_static_pass;
+    hit->idx = idx;
+    hit->fraction = fraction;
+    return fraction;
+}
+
+// finds the first obstacle (static or not) along the start -> end segment
+// returns its index (or -1 if nothing is hit), which of the sets it's in
+// in out_is_static and the hit point as a fraction of the segment in
+// out_fraction
+int raycast_obstacles(
+    Vector2 start, Vector2 end, float *out_fraction, bool *out_is_static
+) {
+    RaycastHit hit = {.start = start, .end = end, .idx = -1, .fraction = 1.0};
+    Rectangle bounds = {
+        .x = fminf(start.x, end.x),
+        .y = fminf(start.y, end.y),
+        .width = fabsf(end.x - start.x),
+        .height = fabsf(end.y - start.y),
+    };
+
+    hit.is_static_pass = true;
+    if (BROADPHASE == BROADPHASE_LINEAR) {
+        for (int i = 0; i < STATIC_OBSTACLES.n; ++i) {
+            clip_raycast_hit(&hit, i, hit.fraction);
+        }
+    } else {
+        build_static_obstacles();
+        raycast_static_bvh(&STATIC_OBSTACLES_BVH, start, end, clip_raycast_hit, &hit);
+    }
+
+    hit.is_static_pass = false;
+    if (BROADPHASE == BROADPHASE_BVH) {
+        raycast_bvh(&OBSTACLES_BVH, start, end, clip_raycast_hit, &hit);
+    } else {
+        int n_ids = query_obstacles(bounds, QUERY_IDS);
+        for (int i = 0; i < n_ids; ++i) {
+            clip_raycast_hit(&hit, QUERY_IDS[i], hit.fraction);
+        }
+    }
+
+    *out_fraction = hit.fraction;
+    *out_is_static = hit.is_static;
+    return hit.idx;
+}
+
+// -----------------------------------------------------------------------
+// obstacle
+Rectangle get_obstacle_rect(int idx) {
+    return (Rectangle){
+        .x = OBSTACLES.x[idx],
+        .y = OBSTACLES.y[idx],
+        .width = OBSTACLES.width[idx],
+        .height = OBSTACLES.height[idx],
+    };
+}
+
+// the box of the path, padded against the rounding of the evaluated
+// positions
+#define PATH_BOX_MARGIN 0.01
+
+// the rect the broadphase holds for the obstacle, see OBSTACLE_LOD_DISTANCE
+Rectangle get_obstacle_index_rect(int idx) {
+    Rectangle rect = get_obstacle_rect(idx);
+    if (!OBSTACLES.is_path_indexed[idx]) return rect;
+
+    Vector2 start = OBSTACLES.start[idx];
+    Vector2 step = Vector2Scale(OBSTACLES.direction[idx], OBSTACLES.length[idx]);
+    Vector2 end = Vector2Add(start, step);
+    return (Rectangle){
+        .x = fminf(start.x, end.x) - PATH_BOX_MARGIN,
+        .y = fminf(start.y, end.y) - PATH_BOX_MARGIN,
+        .width = fabsf(step.x) + rect.width + 2.0 * PATH_BOX_MARGIN,
+        .height = fabsf(step.y) + rect.height + 2.0 * PATH_BOX_MARGIN,
+    };
+}
+
+// platforms start path indexed, the next lod pass finds the ones near an
+// agent, so a level spawning many of them isn't indexed twice
+static bool is_obstacle_path_indexable(int idx) {
+    return OBSTACLES.speed[idx] > 0.0 && OBSTACLES.length[idx] > 0.0;
+}
+
+#define grow_array(array, capacity) array = realloc(array, (capacity) * sizeof(*array))
+
+// grows the query scratch shared by the static and dynamic sets
+static void reserve_query_ids(int capacity) {
+    static int query_ids_capacity = 0;
+    if (capacity <= query_ids_capacity) return;
+
+    grow_array(QUERY_IDS, capacity);
+    query_ids_capacity = capacity;
+}
+
+// sizes the collision scratch for every worker and the current pools
+static void reserve_candidates(void) {
+    int n_workers = get_n_job_workers();
+    if (n_workers > N_CANDIDATES) {
+        grow_array(CANDIDATES, n_workers);
+        int n_new = n_workers - N_CANDIDATES;
+        memset(CANDIDATES + N_CANDIDATES, 0, n_new * sizeof(Candidates));
+        N_CANDIDATES = n_workers;
+    }
+
+    int capacity = OBSTACLES.capacity > STATIC_OBSTACLES.capacity
+                       ? OBSTACLES.capacity
+                       : STATIC_OBSTACLES.capacity;
+    for (int i = 0; i < n_workers; ++i) {
+        Candidates *candidates = &CANDIDATES[i];
+        if (capacity <= candidates->capacity) continue;
+
+        grow_array(candidates->static_ids, capacity);
+        grow_array(candidates->ids, capacity);
+        grow_array(candidates->x, capacity);
+        grow_array(candidates->y, capacity);
+        grow_array(candidates->width, capacity);
+        grow_array(candidates->height, capacity);
+        grow_array(candidates->mtv_y, capacity);
+        candidates->capacity = capacity;
+    }
+}
+
+// grows the pool and the per-obstacle scratch arrays
+static void reserve_obstacles(int capacity) {
+    if (capacity <= OBSTACLES.capacity) return;
+
+    grow_array(OBSTACLES.x, capacity);
+    grow_array(OBSTACLES.y, capacity);
+    grow_array(OBSTACLES.width, capacity);
+    grow_array(OBSTACLES.height, capacity);
+    grow_array(OBSTACLES.prev_x, capacity);
+    grow_array(OBSTACLES.prev_y, capacity);
+    grow_array(OBSTACLES.start, capacity);
+    grow_array(OBSTACLES.direction, capacity);
+    grow_array(OBSTACLES.length, capacity);
+    grow_array(OBSTACLES.phase, capacity);
+    grow_array(OBSTACLES.speed, capacity);
+    grow_array(OBSTACLES.is_path_indexed, capacity);
+    grow_array(OBSTACLES.slots, capacity);
+    grow_array(OBSTACLES.slot_idx, capacity);
+    grow_array(OBSTACLES.slot_generations, capacity);
+
+    grow_array(STEPS.x, capacity);
+    grow_array(STEPS.y, capacity);
+    grow_array(IS_NEAR_AGENT, capacity);
+    reserve_query_ids(capacity);
+
+    OBSTACLES.capacity = capacity;
+}
+
+static void grow_obstacles(void) {
+    if (OBSTACLES.n < OBSTACLES.capacity) return;
+    reserve_obstacles(OBSTACLES.capacity ? 2 * OBSTACLES.capacity : 64);
+}
+
+ObstacleHandle get_obstacle_handle(int idx) {
+    int slot = OBSTACLES.slots[idx];
+    return (ObstacleHandle){slot, OBSTACLES.slot_generations[slot]};
+}
+
+// returns the current index of the obstacle, or -1 if it was despawned
+int get_obstacle_idx(ObstacleHandle handle) {
+    if (handle.slot < 0 || handle.slot >= OBSTACLES.n_slots) return -1;
+    if (OBSTACLES.slot_generations[handle.slot] != handle.generation) return -1;
+    return OBSTACLES.slot_idx[handle.slot];
+}
+
+// gives the obstacle at idx a handle slot
+// generations start from 1, so the zero handle is never alive
+static void take_obstacle_slot(int idx) {
+    int slot = OBSTACLES.free_slot;
+    if (slot == -1) {
+        slot = OBSTACLES.n_slots++;
+        OBSTACLES.slot_generations[slot] = 1;
+    } else {
+        OBSTACLES.free_slot = OBSTACLES.slot_idx[slot];
+    }
+
+    OBSTACLES.slot_idx[slot] = idx;
+    OBSTACLES.slots[idx] = slot;
+}
+
+// appends an obstacle moving along its path at offset phase + speed * time
+static ObstacleHandle add_obstacle(
+    Vector2 size,
+    Vector2 start,
+    Vector2 direction,
+    float length,
+    float speed,
+    double phase
+) {
+    grow_obstacles();
+
+    int idx = OBSTACLES.n++;
+    take_obstacle_slot(idx);
+
+    OBSTACLES.width[idx] = size.x;
+    OBSTACLES.height[idx] = size.y;
+    OBSTACLES.speed[idx] = speed;
+
+    OBSTACLES.start[idx] = start;
+    OBSTACLES.direction[idx] = direction;
+    OBSTACLES.length[idx] = length;
+    OBSTACLES.phase[idx] = phase;
+    OBSTACLES.is_path_indexed[idx] = is_obstacle_path_indexable(idx);
+
+    Vector2 path_position = get_platform_position(idx, get_world_time());
+    OBSTACLES.x[idx] = path_position.x;
+    OBSTACLES.y[idx] = path_position.y;
+    OBSTACLES.prev_x[idx] = path_position.x;
+    OBSTACLES.prev_y[idx] = path_position.y;
+
+    insert_obstacle_index(idx);
+
+    return get_obstacle_handle(idx);
+}
+
+ObstacleHandle spawn_obstacle(Rectangle rect, Vector2 start, Vector2 end, float speed) {
+    // the platform starts from its rect position projected on the path,
+    // moving to the end
+    Vector2 position = {rect.x, rect.y};
+    float length = Vector2Distance(start, end);
+    if (!(speed > 0.0) || !(length > 0.0)) {
+        start = position;
+        length = 0.0;
+    }
+    Vector2 direction = Vector2Normalize(Vector2Subtract(end, start));
+    float offset = Vector2DotProduct(Vector2Subtract(position, start), direction);
+    offset = Clamp(offset, 0.0, length);
+
+    return add_obstacle(
+        (Vector2){rect.width, rect.height},
+        start,
+        length > 0.0 ? direction : Vector2Zero(),
+        length,
+        speed,
+        offset - speed * get_world_time()
+    );
+}
+
+// the platform is at offset phase along its path at world time 0, so where
+// it is doesn't depend on when it's spawned (streamed chunks spawned again
+// get their platforms back in place)
+// zero speed or length spawns it fixed at the start
+ObstacleHandle spawn_platform(
+    Vector2 size, Vector2 start, Vector2 end, float speed, double phase
+) {
+    float length = Vector2Distance(start, end);
+    if (!(speed > 0.0) || !(length > 0.0)) {
+        return add_obstacle(size, start, Vector2Zero(), 0.0, speed, 0.0);
+    }
+
+    Vector2 direction = Vector2Normalize(Vector2Subtract(end, start));
+    return add_obstacle(size, start, direction, length, speed, phase);
+}
+
+// n spawn_platform calls at once, with the paths resolved already (unit
+// or zero directions), the arrays are copied in bulk
+void spawn_platforms(
+    int n,
+    const float *width,
+    const float *height,
+    const Vector2 *start,
+    const Vector2 *direction,
+    const float *length,
+    const double *phase,
+    const float *speed
+) {
+    int first = OBSTACLES.n;
+    reserve_obstacles(first + n);
+
+    memcpy(OBSTACLES.width + first, width, n * sizeof(float));
+    memcpy(OBSTACLES.height + first, height, n * sizeof(float));
+    memcpy(OBSTACLES.start + first, start, n * sizeof(Vector2));
+    memcpy(OBSTACLES.direction + first, direction, n * sizeof(Vector2));
+    memcpy(OBSTACLES.length + first, length, n * sizeof(float));
+    memcpy(OBSTACLES.phase + first, phase, n * sizeof(double));
+    memcpy(OBSTACLES.speed + first, speed, n * sizeof(float));
+    for (int i = first; i < first + n; ++i) {
+        take_obstacle_slot(i);
+        OBSTACLES.is_path_indexed[i] = is_obstacle_path_indexable(i);
+    }
+    OBSTACLES.n += n;
+
+    KERNELS->evaluate_platforms(
+        OBSTACLES.start + first,
+        OBSTACLES.direction + first,
+        OBSTACLES.length + first,
+        OBSTACLES.phase + first,
+        OBSTACLES.speed + first,
+        n,
+        get_world_time(),
+        OBSTACLES.x + first,
+        OBSTACLES.y + first,
+        STEPS.x + first,
+        STEPS.y + first
+    );
+    memcpy(OBSTACLES.prev_x + first, OBSTACLES.x + first, n * sizeof(float));
+    memcpy(OBSTACLES.prev_y + first, OBSTACLES.y + first, n * sizeof(float));
+
+    insert_obstacle_indices(first, n);
+}
+
+// -----------------------------------------------------------------------
+// static obstacle
+Rectangle get_static_obstacle_rect(int idx) {
+    return (Rectangle){
+        .x = STATIC_OBSTACLES.x[idx],
+        .y = STATIC_OBSTACLES.y[idx],
+        .width = STATIC_OBSTACLES.width[idx],
+        .height = STATIC_OBSTACLES.height[idx],
+    };
+}
+
+static void reserve_static_obstacles(int capacity) {
+    if (capacity <= STATIC_OBSTACLES.capacity) return;
+
+    grow_array(STATIC_OBSTACLES.x, capacity);
+    grow_array(STATIC_OBSTACLES.y, capacity);
+    grow_array(STATIC_OBSTACLES.width, capacity);
+    grow_array(STATIC_OBSTACLES.height, capacity);
+    reserve_query_ids(capacity);
+    STATIC_OBSTACLES.capacity = capacity;
+}
+
+// points the static set and its tree into a mapped level (which becomes
+// MAPPED_LEVEL), they're used in place until the set changes
+static void map_static_obstacles(const LevelHeader *header, MappedLevel level) {
+    if (STATIC_OBSTACLES.is_mapped) {
+        unmap_level(&MAPPED_LEVEL);
+    } else {
+        free(STATIC_OBSTACLES.x);
+        free(STATIC_OBSTACLES.y);
+        free(STATIC_OBSTACLES.width);
+        free(STATIC_OBSTACLES.height);
+        free_static_bvh(&STATIC_OBSTACLES_BVH);
+    }
+    MAPPED_LEVEL = level;
+
+    int n = header->n_static_obstacles;
+    STATIC_OBSTACLES.x = (float *)get_level_section(header, LEVEL_STATIC_X);
+    STATIC_OBSTACLES.y = (float *)get_level_section(header, LEVEL_STATIC_Y);
+    STATIC_OBSTACLES.width = (float *)get_level_section(header, LEVEL_STATIC_WIDTH);
+    STATIC_OBSTACLES.height = (float *)get_level_section(header, LEVEL_STATIC_HEIGHT);
+    STATIC_OBSTACLES.n = n;
+    STATIC_OBSTACLES.capacity = n;
+    STATIC_OBSTACLES.is_mapped = true;
+    STATIC_OBSTACLES.is_dirty = false;
+    STATIC_OBSTACLES.revision += 1;
+
+    STATIC_OBSTACLES_BVH = (StaticBvh){
+        .n_nodes = header->n_static_bvh_nodes,
+        .nodes = (StaticBvhNode *)get_level_section(header, LEVEL_STATIC_BVH_NODES),
+    };
+    reserve_query_ids(n);
+}
+
+// copies the static set out of the mapped level before it changes, and
+// drops the level
+static void unmap_static_obstacles(void) {
+    if (!STATIC_OBSTACLES.is_mapped) return;
+
+    StaticObstacles mapped = STATIC_OBSTACLES;
+    STATIC_OBSTACLES = (StaticObstacles){
+        .n = mapped.n,
+        .is_dirty = true,
+        .revision = mapped.revision,
+    };
+    STATIC_OBSTACLES_BVH = (StaticBvh){0};
+
+    reserve_static_obstacles(mapped.n < 32 ? 64 : 2 * mapped.n);
+    memcpy(STATIC_OBSTACLES.x, mapped.x, mapped.n * sizeof(float));
+    memcpy(STATIC_OBSTACLES.y, mapped.y, mapped.n * sizeof(float));
+    memcpy(STATIC_OBSTACLES.width, mapped.width, mapped.n * sizeof(float));
+    memcpy(STATIC_OBSTACLES.height, mapped.height, mapped.n * sizeof(float));
+    unmap_level(&MAPPED_LEVEL);
+}
+
+// the static set is indexed in bulk by build_static_obstacles
+void spawn_static_obstacle(Rectangle rect) {
+    unmap_static_obstacles();
+    if (STATIC_OBSTACLES.n == STATIC_OBSTACLES.capacity) {
+        int capacity = STATIC_OBSTACLES.capacity;
+        reserve_static_obstacles(capacity ? 2 * capacity : 64);
+    }
+
+    int idx = STATIC_OBSTACLES.n++;
+    STATIC_OBSTACLES.x[idx] = rect.x;
+    STATIC_OBSTACLES.y[idx] = rect.y;
+    STATIC_OBSTACLES.width[idx] = rect.width;
+    STATIC_OBSTACLES.height[idx] = rect.height;
+    STATIC_OBSTACLES.is_dirty = true;
+    STATIC_OBSTACLES.revision += 1;
+}
+
+static void permute_floats(float *values, const int *order, float *tmp, int n) {
+    for (int i = 0; i < n; ++i) {
+        tmp[i] = values[order[i]];
+    }
+    memcpy(values, tmp, n * sizeof(float));
+}
+
+// builds the static index and lays the static obstacles out in its order,
+// which changes their indices
+// called by load_game, and by the queries if obstacles were spawned after
+void build_static_obstacles(void) {
+    if (!STATIC_OBSTACLES.is_dirty) return;
+
+    int n = STATIC_OBSTACLES.n;
+    int *order = QUERY_IDS;
+    build_static_bvh(
+        &STATIC_OBSTACLES_BVH,
+        STATIC_OBSTACLES.x,
+        STATIC_OBSTACLES.y,
+        STATIC_OBSTACLES.width,
+        STATIC_OBSTACLES.height,
+        n,
+        order
+    );
+
+    float *tmp = malloc(n * sizeof(float));
+    permute_floats(STATIC_OBSTACLES.x, order, tmp, n);
+    permute_floats(STATIC_OBSTACLES.y, order, tmp, n);
+    permute_floats(STATIC_OBSTACLES.width, order, tmp, n);
+    permute_floats(STATIC_OBSTACLES.height, order, tmp, n);
+    free(tmp);
+
+    STATIC_OBSTACLES.is_dirty = false;
+    STATIC_OBSTACLES.revision += 1;
+}
+
+// writes indices of the static obstacles that may overlap the rect into
+// out_ids (which must fit STATIC_OBSTACLES.n) and returns their number
+int query_static_obstacles(Rectangle rect, int *out_ids) {
+    if (BROADPHASE != BROADPHASE_LINEAR) {
+        build_static_obstacles();
+        return query_static_bvh(
+            &STATIC_OBSTACLES_BVH, rect, out_ids, STATIC_OBSTACLES.n
+        );
+    }
+
+    for (int i = 0; i < STATIC_OBSTACLES.n; ++i) {
+        out_ids[i] = i;
+    }
+    return STATIC_OBSTACLES.n;
+}
+
+// -----------------------------------------------------------------------
+// dynamic obstacle
+// moves the last obstacle into the despawned one's place
+// returns false if the handle is stale
+bool despawn_obstacle(ObstacleHandle handle) {
+    int idx = get_obstacle_idx(handle);
+    if (idx == -1) return false;
+
+    int last = OBSTACLES.n - 1;
+    remove_obstacle_index(idx);
+    if (idx != last) {
+        remove_obstacle_index(last);
+
+        OBSTACLES.x[idx] = OBSTACLES.x[last];
+        OBSTACLES.y[idx] = OBSTACLES.y[last];
+        OBSTACLES.width[idx] = OBSTACLES.width[last];
+        OBSTACLES.height[idx] = OBSTACLES.height[last];
+        OBSTACLES.prev_x[idx] = OBSTACLES.prev_x[last];
+        OBSTACLES.prev_y[idx] = OBSTACLES.prev_y[last];
+        OBSTACLES.start[idx] = OBSTACLES.start[last];
+        OBSTACLES.direction[idx] = OBSTACLES.direction[last];
+        OBSTACLES.length[idx] = OBSTACLES.length[last];
+        OBSTACLES.phase[idx] = OBSTACLES.phase[last];
+        OBSTACLES.speed[idx] = OBSTACLES.speed[last];
+        OBSTACLES.is_path_indexed[idx] = OBSTACLES.is_path_indexed[last];
+        OBSTACLES.slots[idx] = OBSTACLES.slots[last];
+        OBSTACLES.slot_idx[OBSTACLES.slots[idx]] = idx;
+
+        insert_obstacle_index(idx);
+    }
+    OBSTACLES.n -= 1;
+
+    // the generation bump makes the handles to this slot stale, the agents
+    // standing on the obstacle are detached with it
+    OBSTACLES.slot_generations[handle.slot] += 1;
+    OBSTACLES.slot_idx[handle.slot] = OBSTACLES.free_slot;
+    OBSTACLES.free_slot = handle.slot;
+
+    return true;
+}
+
+// keeps the capacity, so reloading a level doesn't allocate, and the slot
+// generations, so the handles from before the reset stay stale
+void reset_obstacles(void) {
+    OBSTACLES.free_slot = -1;
+    for (int slot = OBSTACLES.n_slots - 1; slot >= 0; --slot) {
+        OBSTACLES.slot_generations[slot] += 1;
+        OBSTACLES.slot_idx[slot] = OBSTACLES.free_slot;
+        OBSTACLES.free_slot = slot;
+    }
+
+    OBSTACLES.n = 0;
+    STATIC_OBSTACLES.n = 0;
+    STATIC_OBSTACLES.is_dirty = true;
+    STATIC_OBSTACLES.revision += 1;
+    unmap_static_obstacles();
+    reset_grid(&OBSTACLES_GRID, DEFAULT_GRID_CELL_SIZE);
+    reset_bvh(&OBSTACLES_BVH);
+    reset_sap(&OBSTACLES_SAP);
+}
+
+// evaluates the path at any time without touching the obstacle, e.g. for
+// the platforms which are far from every agent
+Vector2 get_platform_position(int idx, double time) {
+    float offset = get_path_offset(
+        OBSTACLES.length[idx], OBSTACLES.phase[idx], OBSTACLES.speed[idx], time
+    );
+    Vector2 step = Vector2Scale(OBSTACLES.direction[idx], offset);
+    return Vector2Add(OBSTACLES.start[idx], step);
+}
+
+// moves the platforms to where they are at the time and reindexes them
+static void move_obstacles(double time) {
+    KERNELS->evaluate_platforms(
+        OBSTACLES.start,
+        OBSTACLES.direction,
+        OBSTACLES.length,
+        OBSTACLES.phase,
+        OBSTACLES.speed,
+        OBSTACLES.n,
+        time,
+        OBSTACLES.x,
+        OBSTACLES.y,
+        STEPS.x,
+        STEPS.y
+    );
+
+    if (BROADPHASE == BROADPHASE_LINEAR) return;
+    for (int i = 0; i < OBSTACLES.n; ++i) {
+        if (OBSTACLES.speed[i] > 0.0 && !OBSTACLES.is_path_indexed[i]) {
+            update_obstacle_index(i);
+        }
+    }
+}
+
+// indexes the moving platforms near an agent by their rect and the others
+// by their path box; either way the index finds every obstacle overlapping
+// a query, so this changes how many candidates the queries get and not
+// the results. sweep and prune is left out, its pairs follow the rects
+static void update_obstacle_lod(void) {
+    if (BROADPHASE != BROADPHASE_GRID && BROADPHASE != BROADPHASE_BVH) return;
+    if ((N_TICKS - 1) % OBSTACLE_LOD_INTERVAL != 0) return;
+
+    memset(IS_NEAR_AGENT, 0, OBSTACLES.n * sizeof(bool));
+    for (int i = 0; i < AGENTS.n; ++i) {
+        Rectangle rect = get_agent_rect(i);
+        rect.x -= OBSTACLE_LOD_DISTANCE;
+        rect.y -= OBSTACLE_LOD_DISTANCE;
+        rect.width += 2.0 * OBSTACLE_LOD_DISTANCE;
+        rect.height += 2.0 * OBSTACLE_LOD_DISTANCE;
+
+        int n_ids = query_obstacles(rect, QUERY_IDS);
+        for (int j = 0; j < n_ids; ++j) {
+            IS_NEAR_AGENT[QUERY_IDS[j]] = true;
+        }
+    }
+
+    // reinserted rather than updated, the trees keep a node whose fat box
+    // still holds the new one
+    for (int i = 0; i < OBSTACLES.n; ++i) {
+        bool is_path_indexed = is_obstacle_path_indexable(i) && !IS_NEAR_AGENT[i];
+        if (is_path_indexed == OBSTACLES.is_path_indexed[i]) continue;
+
+        remove_obstacle_index(i);
+        OBSTACLES.is_path_indexed[i] = is_path_indexed;
+        insert_obstacle_index(i);
+    }
+}
+
+// carries the agents with the platforms they stand on by the last move
+static void carry_agents(void) {
+    for (int i = 0; i < AGENTS.n; ++i) {
+        int idx = get_obstacle_idx(AGENTS.platform[i]);
+        if (idx == -1) continue;
+        AGENTS.x[i] += STEPS.x[idx];
+        AGENTS.y[i] += STEPS.y[idx];
+    }
+}
+
+// the obstacle phases of a tick, for timing them apart from the agents; the
+// lod pass runs on the ticks of N_TICKS it would run on in tick
+void update_obstacles(double time) {
+    update_obstacle_lod();
+    move_obstacles(time);
+    carry_agents();
+}
+
+// -----------------------------------------------------------------------
+// agent
+// puts the agent back to its spawn position with full health
+static void reset_agent(int idx) {
+    Vector2 position = AGENTS.spawn_position[idx];
+    AGENTS.x[idx] = position.x;
+    AGENTS.y[idx] = position.y;
+    AGENTS.prev_x[idx] = position.x;
+    AGENTS.prev_y[idx] = position.y;
+    AGENTS.velocity_x[idx] = 0.0;
+    AGENTS.velocity_y[idx] = 0.0;
+    AGENTS.health[idx] = AGENTS.max_health;
+    AGENTS.is_grounded[idx] = false;
+    AGENTS.platform[idx] = (ObstacleHandle){0};
+}
+
+static int add_agent(Vector2 position) {
+    if (AGENTS.n == AGENTS.capacity) {
+        int capacity = AGENTS.capacity ? 2 * AGENTS.capacity : 16;
+        grow_array(AGENTS.x, capacity);
+        grow_array(AGENTS.y, capacity);
+        grow_array(AGENTS.velocity_x, capacity);
+        grow_array(AGENTS.velocity_y, capacity);
+        grow_array(AGENTS.prev_x, capacity);
+        grow_array(AGENTS.prev_y, capacity);
+        grow_array(AGENTS.health, capacity);
+        grow_array(AGENTS.is_grounded, capacity);
+        grow_array(AGENTS.input, capacity);
+        grow_array(AGENTS.platform, capacity);
+        grow_array(AGENTS.spawn_position, capacity);
+        AGENTS.capacity = capacity;
+    }
+
+    int idx = AGENTS.n++;
+    AGENTS.spawn_position[idx] = position;
+    AGENTS.input[idx] = 0;
+    reset_agent(idx);
+
+    return idx;
+}
+
+// the spawns and respawns of the host are recorded, the ones of
+// load_game are replayed by the load
+int spawn_agent(Vector2 position) {
+    record_spawn(position);
+    return add_agent(position);
+}
+
+void respawn_agent(int idx) {
+    record_respawn(idx);
+    reset_agent(idx);
+}
+
+void reset_agents(void) {
+    if (BROADPHASE == BROADPHASE_SAP) {
+        for (int i = 0; i < AGENTS.n; ++i) {
+            int id = get_sap_agent_id(i);
+            if (is_sap_item_inserted(&OBSTACLES_SAP, id)) {
+                remove_sap_item(&OBSTACLES_SAP, id);
+            }
+        }
+    }
+
+    AGENTS.n = 0;
+    CONTACTS.n = 0;
+    AGENTS.size = (Vector2){1.0, 2.0};
+    AGENTS.speed = 15.0;
+    AGENTS.jump_impulse = 30.0;
+    AGENTS.max_health = AGENT_MAX_HEALTH;
+}
+
+Vector2 get_agent_position(int idx) {
+    return (Vector2){AGENTS.x[idx], AGENTS.y[idx]};
+}
+
+Rectangle get_agent_rect_at(Vector2 position) {
+    return (Rectangle){
+        .x = position.x + 0.5 * AGENTS.size.x,
+        .y = position.y + AGENTS.size.y,
+        .width = AGENTS.size.x,
+        .height = AGENTS.size.y,
+    };
+}
+
+Rectangle get_agent_rect(int idx) {
+    return get_agent_rect_at(get_agent_position(idx));
+}
+
+static void integrate_agents(void *user, int worker, int begin, int end) {
+    float dt = *(float *)user;
+    float gravity_step = GRAVITY_ACCELERATION * dt;
+    float speed_step = AGENTS.speed * dt;
+
+    for (int i = begin; i < end; ++i) {
+        uint32_t input = AGENTS.input[i];
+
+        // gravity
+        float velocity_x = AGENTS.velocity_x[i];
+        float velocity_y = AGENTS.velocity_y[i] + gravity_step;
+
+        // moving (immediate position change)
+        float direction_x = 0.0;
+        if (input & INPUT_LEFT) direction_x -= 1.0;
+        if (input & INPUT_RIGHT) direction_x += 1.0;
+
+        // jumping (velocity change)
+        if ((input & INPUT_JUMP) && AGENTS.is_grounded[i]) {
+            velocity_y -= AGENTS.jump_impulse;
+        }
+
+        // velocity
+        AGENTS.x[i] += direction_x * speed_step + velocity_x * dt;
+        AGENTS.y[i] += velocity_y * dt;
+        AGENTS.velocity_y[i] = velocity_y;
+    }
+}
+
+void update_agents(float dt) {
+    run_parallel_for(AGENTS.n, AGENT_INTEGRATION_CHUNK_SIZE, integrate_agents, &dt);
+}
+
+// runs the batch mtv kernel over the candidate rects, the y components
+// are left in candidates->mtv_y
+// NULL ids mean the candidates are all the rects in order, then the kernel
+// reads the arrays in place
+static MtvBounds get_candidates_mtv(
+    Candidates *candidates,
+    Rectangle rect,
+    const float *x,
+    const float *y,
+    const float *width,
+    const float *height,
+    const int *ids,
+    int n
+) {
+    if (ids == NULL) {
+        return KERNELS->get_aabb_mtv_batch(
+            rect, x, y, width, height, n, candidates->mtv_y
+        );
+    }
+
+    for (int i = 0; i < n; ++i) {
+        int idx = ids[i];
+        candidates->x[i] = x[idx];
+        candidates->y[i] = y[idx];
+        candidates->width[i] = width[idx];
+        candidates->height[i] = height[idx];
+    }
+    return KERNELS->get_aabb_mtv_batch(
+        rect,
+        candidates->x,
+        candidates->y,
+        candidates->width,
+        candidates->height,
+        n,
+        candidates->mtv_y
+    );
+}
+
+static void push_contact(Contacts *contacts, Contact contact) {
+    if (contacts->n == contacts->capacity) {
+        contacts->capacity = contacts->capacity ? 2 * contacts->capacity : 64;
+        grow_array(contacts->items, contacts->capacity);
+    }
+    contacts->items[contacts->n++] = contact;
+}
+
+// writes the agent's state only, so agents can be resolved in parallel;
+// the ground contacts are reported to the worker's contacts
+static void update_agent_collisions_at(Candidates *candidates, int agent) {
+    Rectangle rect = get_agent_rect(agent);
+    bool is_linear = BROADPHASE == BROADPHASE_LINEAR;
+
+    // static geometry only pushes the agent out
+    int *static_ids = candidates->static_ids;
+    int n_static_candidates = query_static_obstacles(rect, static_ids);
+    MtvBounds static_bounds = get_candidates_mtv(
+        candidates,
+        rect,
+        STATIC_OBSTACLES.x,
+        STATIC_OBSTACLES.y,
+        STATIC_OBSTACLES.width,
+        STATIC_OBSTACLES.height,
+        is_linear ? NULL : static_ids,
+        n_static_candidates
+    );
+
+    int *ids = candidates->ids;
+    int n_candidates = query_agent_obstacles(agent, rect, ids);
+    MtvBounds bounds = get_candidates_mtv(
+        candidates,
+        rect,
+        OBSTACLES.x,
+        OBSTACLES.y,
+        OBSTACLES.width,
+        OBSTACLES.height,
+        is_linear ? NULL : ids,
+        n_candidates
+    );
+
+    bounds.min_x = fminf(bounds.min_x, static_bounds.min_x);
+    bounds.max_x = fmaxf(bounds.max_x, static_bounds.max_x);
+    bounds.min_y = fminf(bounds.min_y, static_bounds.min_y);
+    bounds.max_y = fmaxf(bounds.max_y, static_bounds.max_y);
+    bounds.n_overlaps += static_bounds.n_overlaps;
+    candidates->n_tests += n_static_candidates + n_candidates;
+
+    // attach the agent to the moving platform it stands on, the first one
+    // by index, so the choice doesn't depend on the broadphase
+    int platform = -1;
+    for (int i = 0; i < n_candidates; ++i) {
+        int idx = is_linear ? i : ids[i];
+        bool is_standing = candidates->mtv_y[i] < 0.0 && OBSTACLES.speed[idx] > 0.0;
+        if (is_standing && (platform == -1 || idx < platform)) platform = idx;
+    }
+    AGENTS.platform[agent] = platform == -1 ? (ObstacleHandle){0}
+                                            : get_obstacle_handle(platform);
+
+    float mtv_min_x = bounds.min_x;
+    float mtv_max_x = bounds.max_x;
+    float mtv_min_y = bounds.min_y;
+    float mtv_max_y = bounds.max_y;
+
+    Vector2 mtv = {mtv_min_x, mtv_min_y};
+    if (fabsf(mtv_max_x) > fabsf(mtv_min_x)) mtv.x = mtv_max_x;
+    if (fabsf(mtv_max_y) > fabsf(mtv_min_y)) mtv.y = mtv_max_y;
+    AGENTS.x[agent] += mtv.x;
+    AGENTS.y[agent] += mtv.y;
+
+    Vector2 velocity = {AGENTS.velocity_x[agent], AGENTS.velocity_y[agent]};
+    bool is_just_grounded = mtv.y < 0.0 && velocity.y > 0.0;
+    if (is_just_grounded) {
+        Contact contact = {
+            .agent = agent,
+            .mtv = mtv,
+            .impact_speed = Vector2Length(velocity),
+        };
+        push_contact(&candidates->contacts, contact);
+
+        AGENTS.velocity_x[agent] = 0.0;
+        AGENTS.velocity_y[agent] = 0.0;
+        AGENTS.is_grounded[agent] = true;
+    } else if (mtv.y > 0.0 && velocity.y < 0.0) {
+        AGENTS.velocity_y[agent] = 0.0;
+    } else {
+        AGENTS.is_grounded[agent] = false;
+    }
+}
+
+static void collide_agents(void *user, int worker, int begin, int end) {
+    Candidates *candidates = &CANDIDATES[worker];
+    for (int i = begin; i < end; ++i) {
+        update_agent_collisions_at(candidates, i);
+    }
+}
+
+static int compare_contacts(const void *a, const void *b) {
+    return ((const Contact *)a)->agent - ((const Contact *)b)->agent;
+}
+
+// which worker resolved an agent depends on the scheduling, so the
+// contacts are put in agent order before they're applied
+static void merge_contacts(void) {
+    CONTACTS.n = 0;
+    N_COLLISION_TESTS = 0;
+    for (int i = 0; i < get_n_job_workers(); ++i) {
+        Contacts *contacts = &CANDIDATES[i].contacts;
+        for (int j = 0; j < contacts->n; ++j) {
+            push_contact(&CONTACTS, contacts->items[j]);
+        }
+        contacts->n = 0;
+        N_COLLISION_TESTS += CANDIDATES[i].n_tests;
+        CANDIDATES[i].n_tests = 0;
+    }
+    qsort(CONTACTS.items, CONTACTS.n, sizeof(Contact), compare_contacts);
+
+    for (int i = 0; i < CONTACTS.n; ++i) {
+        Contact *contact = &CONTACTS.items[i];
+        float damage = contact->impact_speed - MAX_SPEED_WITHOUT_DAMAGE;
+        damage = damage < 0.0 ? 0.0 : damage;
+
+        AGENTS.health[contact->agent] -= damage;
+    }
+}
+
+void update_agent_collisions(void) {
+    if (BROADPHASE == BROADPHASE_SAP) update_agents_sap();
+
+    // from here on the indices are only read
+    build_static_obstacles();
+    reserve_candidates();
+
+    run_parallel_for(AGENTS.n, AGENT_COLLISION_CHUNK_SIZE, collide_agents, NULL);
+    merge_contacts();
+}
+
+// -----------------------------------------------------------------------
+// game
+// platform sections of a mapped level
+typedef struct LevelPlatformArrays {
+    const float *width;
+    const float *height;
+    const Vector2 *start;
+    const Vector2 *direction;
+    const float *length;
+    const double *phase;
+    const float *speed;
+} LevelPlatformArrays;
+
+static LevelPlatformArrays get_level_platform_arrays(const LevelHeader *header) {
+    return (LevelPlatformArrays){
+        .width = get_level_section(header, LEVEL_PLATFORM_WIDTH),
+        .height = get_level_section(header, LEVEL_PLATFORM_HEIGHT),
+        .start = get_level_section(header, LEVEL_PLATFORM_START),
+        .direction = get_level_section(header, LEVEL_PLATFORM_DIRECTION),
+        .length = get_level_section(header, LEVEL_PLATFORM_LENGTH),
+        .phase = get_level_section(header, LEVEL_PLATFORM_PHASE),
+        .speed = get_level_section(header, LEVEL_PLATFORM_SPEED),
+    };
+}
+
+// spawns the level platforms first to n - 1 and keeps their handles
+static void spawn_level_platforms(LevelPlatformArrays platforms, int first, int n) {
+    int first_idx = OBSTACLES.n;
+    spawn_platforms(
+        n - first,
+        platforms.width + first,
+        platforms.height + first,
+        platforms.start + first,
+        platforms.direction + first,
+        platforms.length + first,
+        platforms.phase + first,
+        platforms.speed + first
+    );
+
+    if (n > LEVEL_PLATFORMS.capacity) {
+        grow_array(LEVEL_PLATFORMS.handles, n);
+        LEVEL_PLATFORMS.capacity = n;
+    }
+    for (int i = first; i < n; ++i) {
+        LEVEL_PLATFORMS.handles[i] = get_obstacle_handle(first_idx + i - first);
+    }
+    LEVEL_PLATFORMS.n = n;
+}
+
+static bool is_level_platform_equal(int idx, LevelPlatformArrays platforms, int i) {
+    return OBSTACLES.width[idx] == platforms.width[i]
+           && OBSTACLES.height[idx] == platforms.height[i]
+           && OBSTACLES.start[idx].x == platforms.start[i].x
+           && OBSTACLES.start[idx].y == platforms.start[i].y
+           && OBSTACLES.direction[idx].x == platforms.direction[i].x
+           && OBSTACLES.direction[idx].y == platforms.direction[i].y
+           && OBSTACLES.length[idx] == platforms.length[i]
+           && OBSTACLES.phase[idx] == platforms.phase[i]
+           && OBSTACLES.speed[idx] == platforms.speed[i];
+}
+
+// puts the platform on its new path, where it is at the world time, with
+// no step to interpolate or carry the agents by
+static void patch_level_platform(int idx, LevelPlatformArrays platforms, int i) {
+    remove_obstacle_index(idx);
+
+    OBSTACLES.width[idx] = platforms.width[i];
+    OBSTACLES.height[idx] = platforms.height[i];
+    OBSTACLES.start[idx] = platforms.start[i];
+    OBSTACLES.direction[idx] = platforms.direction[i];
+    OBSTACLES.length[idx] = platforms.length[i];
+    OBSTACLES.phase[idx] = platforms.phase[i];
+    OBSTACLES.speed[idx] = platforms.speed[i];
+    OBSTACLES.is_path_indexed[idx] = is_obstacle_path_indexable(idx);
+
+    Vector2 position = get_platform_position(idx, get_world_time());
+    OBSTACLES.x[idx] = position.x;
+    OBSTACLES.y[idx] = position.y;
+    OBSTACLES.prev_x[idx] = position.x;
+    OBSTACLES.prev_y[idx] = position.y;
+    STEPS.x[idx] = 0.0;
+    STEPS.y[idx] = 0.0;
+
+    insert_obstacle_index(idx);
+}
+
+static bool is_static_level_equal(const LevelHeader *header) {
+    int n = header->n_static_obstacles;
+    if (STATIC_OBSTACLES.n != n) return false;
+    if (n == 0) return true;
+
+    const float *arrays[] = {
+        STATIC_OBSTACLES.x,
+        STATIC_OBSTACLES.y,
+        STATIC_OBSTACLES.width,
+        STATIC_OBSTACLES.height,
+    };
+    for (int i = 0; i < 4; ++i) {
+        const void *section = get_level_section(header, LEVEL_STATIC_X + i);
+        if (memcmp(arrays[i], section, n * sizeof(float)) != 0) return false;
+    }
+    return true;
+}
+
+// points the static set into the file and copies the platforms out of it
+static bool load_level_file(const char *path) {
+    MappedLevel level;
+    const LevelHeader *header = map_level(path, &level);
+    if (header == NULL) return false;
+
+    map_static_obstacles(header, level);
+    spawn_level_platforms(get_level_platform_arrays(header), 0, header->n_platforms);
+    LEVEL_PLATFORMS.is_loaded = true;
+    add_agent(header->spawn_position);
+    clear_tower();
+
+    return true;
+}
+
+// patches the changes of the level file into the running level: the static
+// set switches to the new file with its tree, the platforms that changed are
+// put on their new paths in place and reindexed, the ones added or removed
+// at the end are spawned or despawned; the agents, the world time and the
+// untouched platforms keep their state
+// platforms are matched by their order in the file, the spawn position is
+// taken by the next load_game
+// returns false, and keeps the level as it is, if the level isn't a file
+// or the file can't be loaded
+bool reload_level(LevelPatch *out_patch) {
+    *out_patch = (LevelPatch){0};
+    if (!LEVEL_PLATFORMS.is_loaded) return false;
+
+    MappedLevel level;
+    const LevelHeader *header = map_level(LEVEL_PATH, &level);
+    if (header == NULL) return false;
+
+    out_patch->is_static_changed = !is_static_level_equal(header);
+    map_static_obstacles(header, level);
+
+    LevelPlatformArrays platforms = get_level_platform_arrays(header);
+    int n = header->n_platforms;
+    int n_kept = n < LEVEL_PLATFORMS.n ? n : LEVEL_PLATFORMS.n;
+    for (int i = 0; i < n_kept; ++i) {
+        // despawned by the game
+        int idx = get_obstacle_idx(LEVEL_PLATFORMS.handles[i]);
+        if (idx == -1 || is_level_platform_equal(idx, platforms, i)) continue;
+
+        patch_level_platform(idx, platforms, i);
+        out_patch->n_changed_platforms += 1;
+    }
+
+    for (int i = LEVEL_PLATFORMS.n - 1; i >= n; --i) {
+        despawn_obstacle(LEVEL_PLATFORMS.handles[i]);
+        out_patch->n_removed_platforms += 1;
+    }
+    LEVEL_PLATFORMS.n = n_kept;
+    if (n > n_kept) {
+        spawn_level_platforms(platforms, n_kept, n);
+        out_patch->n_added_platforms = n - n_kept;
+    }
+
+    return true;
+}
+
+// spawns the level file (LEVEL_PATH) or the base of the tower, and agent 0,
+// the tower chunks above the base are streamed in; the hosts spawn more
+// agents after it
+// returns false if the level file can't be loaded, the tower is loaded
+// instead
+bool load_game(void) {
+    record_load();
+    uint64_t level_seed = next_rng_u64(&WORLD_RNG);
+
+    reset_obstacles();
+    reset_agents();
+    LEVEL_PLATFORMS.is_loaded = false;
+    LEVEL_PLATFORMS.n = 0;
+    TICK_ACCUMULATOR = 0.0;
+    N_TICKS = 0;
+
+    if (LEVEL_PATH != NULL && load_level_file(LEVEL_PATH)) return true;
+
+    add_agent(Vector2Zero());
+
+    // ground
+    spawn_static_obstacle((Rectangle){.x = -20.0, .y = 20.0, .width = 40.0, .height = 2.5}
+    );
+
+    // left wall, up to the tower
+    spawn_static_obstacle((Rectangle
+    ){.x = -20.0, .y = TOWER_BASE_Y, .width = 2.5, .height = 20.0 - TOWER_BASE_Y});
+
+    // left stair
+    spawn_static_obstacle((Rectangle){.x = -17.5, .y = 15.0, .width = 2.5, .height = 5.0}
+    );
+
+    // right wall, up to the tower
+    spawn_static_obstacle((Rectangle
+    ){.x = 17.5, .y = TOWER_BASE_Y, .width = 2.5, .height = 20.0 - TOWER_BASE_Y});
+
+    build_static_obstacles();
+
+    // the tower above, in chunks
+    reset_tower(level_seed);
+
+    return LEVEL_PATH == NULL;
+}
+
+// fnv-1a over the agent and obstacle state, to find where two runs diverge
+uint32_t get_state_hash(void) {
+    const struct {
+        const void *data;
+        size_t size;
+    } arrays[] = {
+        {AGENTS.x, AGENTS.n * sizeof(float)},
+        {AGENTS.y, AGENTS.n * sizeof(float)},
+        {AGENTS.velocity_x, AGENTS.n * sizeof(float)},
+        {AGENTS.velocity_y, AGENTS.n * sizeof(float)},
+        {AGENTS.health, AGENTS.n * sizeof(float)},
+        {AGENTS.is_grounded, AGENTS.n * sizeof(bool)},
+        {OBSTACLES.x, OBSTACLES.n * sizeof(float)},
+        {OBSTACLES.y, OBSTACLES.n * sizeof(float)},
+    };
+
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < (int)(sizeof(arrays) / sizeof(arrays[0])); ++i) {
+        const uint8_t *bytes = arrays[i].data;
+        for (size_t j = 0; j < arrays[i].size; ++j) {
+            hash = (hash ^ bytes[j]) * 16777619u;
+        }
+    }
+    return hash;
+}
+
+// -----------------------------------------------------------------------
+// timing
+float get_tick_dt(void) {
+    return 1.0 / TICK_RATE;
+}
+
+// simulated seconds since load_game, counted in ticks so it doesn't drift
+double get_world_time(void) {
+    return (double)N_TICKS / TICK_RATE;
+}
+
+// fraction of a tick elapsed since the last simulated state
+float get_tick_alpha(void) {
+    return TICK_ACCUMULATOR / get_tick_dt();
+}
+
+// -----------------------------------------------------------------------
+// tick phases
+// state the phases of a tick read and write, as TaskGraph resource bits
+typedef enum TickResource {
+    TICK_AGENT_INPUT = 1 << 0,
+    TICK_AGENT_POSITIONS = 1 << 1,
+    TICK_AGENT_PREV_POSITIONS = 1 << 2,
+    TICK_AGENT_VELOCITIES = 1 << 3,
+    // health, grounding, platform attachment and CONTACTS
+    TICK_AGENT_CONTACTS = 1 << 4,
+    TICK_OBSTACLE_POSITIONS = 1 << 5,
+    TICK_OBSTACLE_PREV_POSITIONS = 1 << 6,
+    TICK_OBSTACLE_STEPS = 1 << 7,
+    // the broadphase indices, the sweep and prune one also holds the agents
+    TICK_OBSTACLE_INDICES = 1 << 8,
+} TickResource;
+
+static TaskGraph TICK_GRAPH;
+
+// dt of the tick the graph runs
+static float TICK_DT;
+
+// streamed chunks spawn where they are at the start of the tick, so the
+// rest of the tick treats them like the obstacles already there
+static void stream_tower(void *user) {
+    update_tower();
+}
+
+static void run_update_obstacle_lod(void *user) {
+    update_obstacle_lod();
+}
+
+static void save_agent_positions(void *user) {
+    memcpy(AGENTS.prev_x, AGENTS.x, AGENTS.n * sizeof(float));
+    memcpy(AGENTS.prev_y, AGENTS.y, AGENTS.n * sizeof(float));
+}
+
+static void save_obstacle_positions(void *user) {
+    memcpy(OBSTACLES.prev_x, OBSTACLES.x, OBSTACLES.n * sizeof(float));
+    memcpy(OBSTACLES.prev_y, OBSTACLES.y, OBSTACLES.n * sizeof(float));
+}
+
+static void run_update_agents(void *user) {
+    update_agents(TICK_DT);
+}
+
+// platforms are evaluated at the time this tick ends
+static void run_move_obstacles(void *user) {
+    move_obstacles(get_world_time());
+}
+
+static void run_carry_agents(void *user) {
+    carry_agents();
+}
+
+static void run_update_agent_collisions(void *user) {
+    update_agent_collisions();
+}
+
+// the jump press is consumed by the first tick after it was sampled
+static void consume_jumps(void *user) {
+    for (int i = 0; i < AGENTS.n; ++i) {
+        AGENTS.input[i] &= ~INPUT_JUMP;
+    }
+}
+
+// the phases are added in the serial order, the graph runs the agent and
+// the obstacle phases side by side where they don't touch the same state
+static void build_tick_graph(void) {
+    TaskGraph *graph = &TICK_GRAPH;
+    reset_task_graph(graph);
+
+    add_task(
+        graph,
+        "stream_tower",
+        stream_tower,
+        NULL,
+        TICK_AGENT_POSITIONS,
+        TICK_OBSTACLE_POSITIONS | TICK_OBSTACLE_PREV_POSITIONS | TICK_OBSTACLE_INDICES
+            | TICK_AGENT_CONTACTS
+    );
+    add_task(
+        graph,
+        "update_obstacle_lod",
+        run_update_obstacle_lod,
+        NULL,
+        TICK_AGENT_POSITIONS | TICK_OBSTACLE_POSITIONS,
+        TICK_OBSTACLE_INDICES
+    );
+    add_task(
+        graph,
+        "save_agent_positions",
+        save_agent_positions,
+        NULL,
+        TICK_AGENT_POSITIONS,
+        TICK_AGENT_PREV_POSITIONS
+    );
+    add_task(
+        graph,
+        "save_obstacle_positions",
+        save_obstacle_positions,
+        NULL,
+        TICK_OBSTACLE_POSITIONS,
+        TICK_OBSTACLE_PREV_POSITIONS
+    );
+    add_task(
+        graph,
+        "update_agents",
+        run_update_agents,
+        NULL,
+        TICK_AGENT_INPUT | TICK_AGENT_CONTACTS | TICK_AGENT_VELOCITIES,
+        TICK_AGENT_POSITIONS | TICK_AGENT_VELOCITIES
+    );
+    add_task(
+        graph,
+        "move_obstacles",
+        run_move_obstacles,
+        NULL,
+        TICK_OBSTACLE_POSITIONS,
+        TICK_OBSTACLE_POSITIONS | TICK_OBSTACLE_STEPS | TICK_OBSTACLE_INDICES
+    );
+    add_task(
+        graph,
+        "carry_agents",
+        run_carry_agents,
+        NULL,
+        TICK_OBSTACLE_STEPS | TICK_AGENT_CONTACTS,
+        TICK_AGENT_POSITIONS
+    );
+    add_task(
+        graph,
+        "update_agent_collisions",
+        run_update_agent_collisions,
+        NULL,
+        TICK_OBSTACLE_POSITIONS | TICK_AGENT_VELOCITIES,
+        TICK_AGENT_POSITIONS | TICK_AGENT_VELOCITIES | TICK_AGENT_CONTACTS
+            | TICK_OBSTACLE_INDICES
+    );
+    add_task(graph, "consume_jumps", consume_jumps, NULL, 0, TICK_AGENT_INPUT);
+}
+
+// one fixed simulation step
+// returns false if there was nothing to simulate (the replay ended)
+bool tick(float dt) {
+    if (TICK_GRAPH.n_tasks == 0) build_tick_graph();
+    if (!begin_replay_tick()) return false;
+    PROFILE_ZONE("tick");
+
+    N_TICKS += 1;
+    TICK_DT = dt;
+    run_task_graph(&TICK_GRAPH);
+    PROFILE_COUNTER("obstacles", STATIC_OBSTACLES.n + OBSTACLES.n);
+    PROFILE_COUNTER("collision_tests", N_COLLISION_TESTS);
+
+    end_replay_tick();
+    return true;
+}
+
+// samples host input and clock and runs as many ticks as the elapsed time
+// covers, catching up after a hitch, but drops the time it can't simulate
+// within the tick budget
+// returns the number of ticks simulated
+int update_simulation(void) {
+    float tick_dt = get_tick_dt();
+
+    // the jump press is latched until a tick consumes it, so it's neither
+    // lost (no tick this frame) nor repeated (many ticks this frame)
+    // a playback latches the recorded inputs by itself
+    for (int i = 0; i < AGENTS.n && REPLAY.mode != REPLAY_PLAYING; ++i) {
+        uint32_t input = SIM_HOST.get_input(SIM_HOST.user, i);
+        AGENTS.input[i] = (AGENTS.input[i] & INPUT_JUMP) | input;
+    }
+
+    TICK_ACCUMULATOR += SIM_HOST.get_frame_time(SIM_HOST.user);
+    int n_ticks = 0;
+    while (TICK_ACCUMULATOR >= tick_dt && n_ticks < MAX_N_TICKS_PER_FRAME) {
+        if (!tick(tick_dt)) break;
+        TICK_ACCUMULATOR -= tick_dt;
+        n_ticks += 1;
+    }
+    if (TICK_ACCUMULATOR >= tick_dt) TICK_ACCUMULATOR = fmodf(TICK_ACCUMULATOR, tick_dt);
+
+    return n_ticks;
+}
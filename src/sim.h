@@ -0,0 +1,324 @@
+#pragma once
+
+#include "bvh.h"
+#include "grid.h"
+#include "jobs.h"
+#include "kernels.h"
+#include "level.h"
+#include "raylib.h"
+#include "replay.h"
+#include "rng.h"
+#include "sap.h"
+#include "static_bvh.h"
+#include "tasks.h"
+#include "tower.h"
+#include <stdint.h>
+
+// -----------------------------------------------------------------------
+// simulation: agents, obstacles and their physics
+// doesn't depend on the raylib window, input or clock, everything
+// platform-specific is injected through SimHost
+
+#define GRAVITY_ACCELERATION 50.0
+
+// simulation runs at a fixed tick rate independent of the render rate
+#define DEFAULT_TICK_RATE 120
+#define MAX_N_TICKS_PER_FRAME 8
+
+#define AGENT_MAX_HEALTH 100.0
+#define MAX_SPEED_WITHOUT_DAMAGE 30.0
+
+// agents per job pool chunk, the integration is a few loads and stores per
+// agent, the collision pass runs the broadphase queries
+#define AGENT_INTEGRATION_CHUNK_SIZE 1024
+#define AGENT_COLLISION_CHUNK_SIZE 64
+
+// moving platforms farther than this from every agent are indexed by the
+// box of their whole path, which holds them wherever they are, so they're
+// not reindexed every tick; the near ones are indexed by their rect, so the
+// queries get fewer candidates. reclassified every OBSTACLE_LOD_INTERVAL
+// ticks, with the grid and bvh broadphases
+#define OBSTACLE_LOD_DISTANCE 16.0
+#define OBSTACLE_LOD_INTERVAL 30
+
+// -----------------------------------------------------------------------
+// host
+typedef enum InputFlag {
+    INPUT_LEFT = 1 << 0,
+    INPUT_RIGHT = 1 << 1,
+    INPUT_JUMP = 1 << 2,
+} InputFlag;
+
+typedef struct SimHost {
+    void *user;
+
+    // returns InputFlag bits of the agent sampled for the current frame
+    // INPUT_JUMP is a press (edge), not a hold
+    uint32_t (*get_input)(void *user, int agent);
+
+    // returns seconds elapsed since the previous call
+    float (*get_frame_time)(void *user);
+} SimHost;
+
+extern SimHost SIM_HOST;
+
+// -----------------------------------------------------------------------
+// obstacle handle
+// stays valid for the obstacle lifetime, unlike its index
+typedef struct ObstacleHandle {
+    int slot;
+    // zero for the null handle
+    uint32_t generation;
+} ObstacleHandle;
+
+// -----------------------------------------------------------------------
+// agent
+// bodies driven by input (the local player, bots), in structure-of-arrays
+// layout so the integration and collision passes are batch loops
+typedef struct Agents {
+    int n;
+    int capacity;
+
+    // shared by all the agents
+    Vector2 size;
+    float speed;
+    float jump_impulse;
+    float max_health;
+
+    float *x;
+    float *y;
+    float *velocity_x;
+    float *velocity_y;
+
+    // position before the last simulation tick (for render interpolation)
+    float *prev_x;
+    float *prev_y;
+
+    float *health;
+    bool *is_grounded;
+
+    // InputFlag bits, the jump press is latched until a tick consumes it
+    uint32_t *input;
+
+    // platform the agent stands on and is carried by (null handle if none)
+    ObstacleHandle *platform;
+
+    Vector2 *spawn_position;
+} Agents;
+
+extern Agents AGENTS;
+
+// agent pushed up out of an obstacle while falling (landing on it or
+// resting on it), reported by the collision pass
+typedef struct Contact {
+    int agent;
+    Vector2 mtv;
+    // above MAX_SPEED_WITHOUT_DAMAGE the agent takes the difference as damage
+    float impact_speed;
+} Contact;
+
+typedef struct Contacts {
+    int n;
+    int capacity;
+    Contact *items;
+} Contacts;
+
+// ground contacts of the last tick, in agent order
+extern Contacts CONTACTS;
+
+// -----------------------------------------------------------------------
+// obstacle
+// growable pool in structure-of-arrays layout: the collision pass streams
+// through the rect arrays only, the platform path data is cold
+// obstacles are stored densely (despawning moves the last one into the
+// hole), so their indices change and are valid until the next despawn
+typedef struct Obstacles {
+    int n;
+    int capacity;
+
+    // rect
+    float *x;
+    float *y;
+    float *width;
+    float *height;
+
+    // rect position before the last simulation tick (for render interpolation)
+    float *prev_x;
+    float *prev_y;
+
+    // platform path, the position is a function of the world time (see
+    // get_path_offset), so any tick can be evaluated directly
+    // static obstacles spawned as platforms have zero length
+    Vector2 *start;
+    Vector2 *direction;
+    float *length;
+    double *phase;
+    float *speed;
+
+    // indexed by the box of the whole path (see OBSTACLE_LOD_DISTANCE)
+    bool *is_path_indexed;
+
+    // handle slot by obstacle index
+    int *slots;
+
+    // obstacle index by handle slot for live slots, next free slot for the
+    // free ones (-1 terminated), there are never more slots than capacity
+    int n_slots;
+    int free_slot;
+    int *slot_idx;
+    uint32_t *slot_generations;
+} Obstacles;
+
+extern Obstacles OBSTACLES;
+
+// geometry that never moves (walls, floors), kept apart from the pool: it's
+// not stepped per tick and it's indexed once, in bulk, by a static tree
+// its indices change when the index is built
+typedef struct StaticObstacles {
+    int n;
+    int capacity;
+
+    float *x;
+    float *y;
+    float *width;
+    float *height;
+
+    // spawned since the last build_static_obstacles
+    bool is_dirty;
+
+    // bumped whenever the set or its order changes, for the views built
+    // from it
+    uint32_t revision;
+
+    // the arrays and the static tree point into MAPPED_LEVEL (read-only),
+    // spawning copies them out first
+    bool is_mapped;
+} StaticObstacles;
+
+extern StaticObstacles STATIC_OBSTACLES;
+extern StaticBvh STATIC_OBSTACLES_BVH;
+
+// -----------------------------------------------------------------------
+// broadphase
+// selects how the obstacles that may touch an agent are found
+// static obstacles always use their static tree, except with the linear
+// broadphase, which tests everything
+// changing it takes effect from the next load_game
+typedef enum Broadphase {
+    BROADPHASE_LINEAR,
+    BROADPHASE_GRID,
+    BROADPHASE_BVH,
+    BROADPHASE_SAP,
+    N_BROADPHASES,
+} Broadphase;
+
+extern Broadphase BROADPHASE;
+
+// spatial hash over OBSTACLES rects, ids are obstacle indices
+extern Grid OBSTACLES_GRID;
+
+// dynamic AABB tree over OBSTACLES rects, ids are obstacle indices
+extern Bvh OBSTACLES_BVH;
+
+// sweep and prune over OBSTACLES rects and the agents, ids are
+// 2 * obstacle index + 1 and 2 * agent index, only the agent-obstacle
+// pairs are tracked
+extern Sap OBSTACLES_SAP;
+
+// -----------------------------------------------------------------------
+// randomness
+// stream ids under the world seed (seed_random) and under the seed a level
+// load draws from the world stream
+typedef enum RngStream {
+    RNG_STREAM_WORLD,
+    RNG_STREAM_PLATFORM_X,
+    RNG_STREAM_PLATFORM_SPEED,
+    // hosts take their streams (bots, ...) from here on
+    RNG_STREAM_HOST = 1 << 16,
+} RngStream;
+
+// -----------------------------------------------------------------------
+// level
+// binary level file load_game loads instead of the tower, NULL for the
+// tower
+extern const char *LEVEL_PATH;
+
+// what reload_level changed
+typedef struct LevelPatch {
+    bool is_static_changed;
+    int n_changed_platforms;
+    int n_added_platforms;
+    int n_removed_platforms;
+} LevelPatch;
+
+// -----------------------------------------------------------------------
+// timing
+extern int TICK_RATE;
+
+// unsimulated time left after the last tick, always less than one tick
+extern float TICK_ACCUMULATOR;
+
+// number of ticks simulated since load_game
+extern uint64_t N_TICKS;
+
+// agent-obstacle pairs the last tick tested past the broadphase
+extern int N_COLLISION_TESTS;
+
+// -----------------------------------------------------------------------
+// api
+void seed_random(uint64_t seed);
+float randf(void);
+float randf_min_max(float min, float max);
+
+const char *get_broadphase_name(Broadphase broadphase);
+
+Rectangle get_obstacle_rect(int idx);
+Rectangle get_obstacle_index_rect(int idx);
+ObstacleHandle get_obstacle_handle(int idx);
+int get_obstacle_idx(ObstacleHandle handle);
+ObstacleHandle spawn_obstacle(Rectangle rect, Vector2 start, Vector2 end, float speed);
+ObstacleHandle spawn_platform(
+    Vector2 size, Vector2 start, Vector2 end, float speed, double phase
+);
+void spawn_platforms(
+    int n,
+    const float *width,
+    const float *height,
+    const Vector2 *start,
+    const Vector2 *direction,
+    const float *length,
+    const double *phase,
+    const float *speed
+);
+bool despawn_obstacle(ObstacleHandle handle);
+void reset_obstacles(void);
+
+Rectangle get_static_obstacle_rect(int idx);
+void spawn_static_obstacle(Rectangle rect);
+void build_static_obstacles(void);
+int query_static_obstacles(Rectangle rect, int *out_ids);
+int query_obstacles(Rectangle rect, int *out_ids);
+int raycast_obstacles(
+    Vector2 start, Vector2 end, float *out_fraction, bool *out_is_static
+);
+Vector2 get_platform_position(int idx, double time);
+void update_obstacles(double time);
+
+int spawn_agent(Vector2 position);
+void respawn_agent(int idx);
+void reset_agents(void);
+Vector2 get_agent_position(int idx);
+Rectangle get_agent_rect_at(Vector2 position);
+Rectangle get_agent_rect(int idx);
+void update_agents(float dt);
+void update_agent_collisions(void);
+
+bool load_game(void);
+bool reload_level(LevelPatch *out_patch);
+uint32_t get_state_hash(void);
+
+float get_tick_dt(void);
+double get_world_time(void);
+float get_tick_alpha(void);
+bool tick(float dt);
+int update_simulation(void);
@@ -0,0 +1,191 @@
+#include "static_bvh.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+// a walk depth first, pushing both children, holds at most one node per
+// level plus one
+#define STATIC_BVH_STACK_SIZE (STATIC_BVH_MAX_DEPTH + 1)
+
+typedef struct Builder {
+    StaticBvh *bvh;
+    BvhAabb *aabbs;
+    float *centers[2];
+    int *order;
+} Builder;
+
+// -----------------------------------------------------------------------
+// build
+// partially sorts order[begin..end) by the axis center, so that the
+// median is in place with the smaller centers before it
+static void select_median(Builder *builder, int axis, int begin, int end) {
+    float *centers = builder->centers[axis];
+    int *order = builder->order;
+    int median = begin + (end - begin) / 2;
+
+    int lo = begin;
+    int hi = end - 1;
+    while (lo < hi) {
+        float pivot = centers[order[lo + (hi - lo) / 2]];
+        int i = lo;
+        int j = hi;
+        while (i <= j) {
+            while (centers[order[i]] < pivot) ++i;
+            while (centers[order[j]] > pivot) --j;
+            if (i <= j) {
+                int t = order[i];
+                order[i++] = order[j];
+                order[j--] = t;
+            }
+        }
+
+        if (median <= j) hi = j;
+        else if (median >= i) lo = i;
+        else break;
+    }
+}
+
+static int build_node(Builder *builder, int begin, int end) {
+    StaticBvh *bvh = builder->bvh;
+    int idx = bvh->n_nodes++;
+
+    BvhAabb aabb = builder->aabbs[builder->order[begin]];
+    BvhAabb centers = {INFINITY, INFINITY, -INFINITY, -INFINITY};
+    for (int i = begin; i < end; ++i) {
+        int item = builder->order[i];
+        BvhAabb item_aabb = builder->aabbs[item];
+        aabb.min_x = fminf(aabb.min_x, item_aabb.min_x);
+        aabb.min_y = fminf(aabb.min_y, item_aabb.min_y);
+        aabb.max_x = fmaxf(aabb.max_x, item_aabb.max_x);
+        aabb.max_y = fmaxf(aabb.max_y, item_aabb.max_y);
+
+        centers.min_x = fminf(centers.min_x, builder->centers[0][item]);
+        centers.min_y = fminf(centers.min_y, builder->centers[1][item]);
+        centers.max_x = fmaxf(centers.max_x, builder->centers[0][item]);
+        centers.max_y = fmaxf(centers.max_y, builder->centers[1][item]);
+    }
+    bvh->nodes[idx].aabb = aabb;
+
+    if (end - begin <= STATIC_BVH_MAX_LEAF_SIZE) {
+        bvh->nodes[idx].first = begin;
+        bvh->nodes[idx].n_items = end - begin;
+        return idx;
+    }
+
+    // split along the longer extent of the item centers
+    float extent_x = centers.max_x - centers.min_x;
+    float extent_y = centers.max_y - centers.min_y;
+    int axis = extent_x >= extent_y ? 0 : 1;
+    int median = begin + (end - begin) / 2;
+    select_median(builder, axis, begin, end);
+
+    build_node(builder, begin, median);
+    bvh->nodes[idx].first = build_node(builder, median, end);
+    bvh->nodes[idx].n_items = 0;
+    return idx;
+}
+
+void free_static_bvh(StaticBvh *bvh) {
+    free(bvh->nodes);
+    *bvh = (StaticBvh){0};
+}
+
+void build_static_bvh(
+    StaticBvh *bvh,
+    const float *x,
+    const float *y,
+    const float *width,
+    const float *height,
+    int n,
+    int *out_order
+) {
+    bvh->n_nodes = 0;
+    if (n == 0) return;
+
+    // a binary tree with leaves of at least one item
+    int n_nodes = 2 * n - 1;
+    if (n_nodes > bvh->capacity) {
+        bvh->nodes = realloc(bvh->nodes, n_nodes * sizeof(StaticBvhNode));
+        bvh->capacity = n_nodes;
+    }
+
+    Builder builder = {
+        .bvh = bvh,
+        .aabbs = malloc(n * sizeof(BvhAabb)),
+        .centers = {malloc(n * sizeof(float)), malloc(n * sizeof(float))},
+        .order = out_order,
+    };
+    for (int i = 0; i < n; ++i) {
+        Rectangle rect = {x[i], y[i], width[i], height[i]};
+        builder.aabbs[i] = get_rect_aabb(rect);
+        builder.centers[0][i] = x[i] + 0.5 * width[i];
+        builder.centers[1][i] = y[i] + 0.5 * height[i];
+        out_order[i] = i;
+    }
+
+    build_node(&builder, 0, n);
+
+    free(builder.aabbs);
+    free(builder.centers[0]);
+    free(builder.centers[1]);
+}
+
+// -----------------------------------------------------------------------
+// queries
+int query_static_bvh(StaticBvh *bvh, Rectangle rect, int *out_ids, int max_n_ids) {
+    if (bvh->n_nodes == 0) return 0;
+
+    BvhAabb aabb = get_rect_aabb(rect);
+    int stack[STATIC_BVH_STACK_SIZE];
+    int n_stack = 0;
+    int n_ids = 0;
+
+    stack[n_stack++] = 0;
+    while (n_stack > 0) {
+        int idx = stack[--n_stack];
+        StaticBvhNode *node = &bvh->nodes[idx];
+        if (!is_aabb_overlap(node->aabb, aabb)) continue;
+
+        if (node->n_items > 0) {
+            for (int i = 0; i < node->n_items; ++i) {
+                if (n_ids == max_n_ids) return n_ids;
+                out_ids[n_ids++] = node->first + i;
+            }
+        } else {
+            stack[n_stack++] = node->first;
+            stack[n_stack++] = idx + 1;
+        }
+    }
+
+    return n_ids;
+}
+
+// leaves report all their items, the callback tests the item rects
+void raycast_static_bvh(
+    StaticBvh *bvh, Vector2 start, Vector2 end, BvhRaycastFn fn, void *user
+) {
+    if (bvh->n_nodes == 0) return;
+
+    float max_fraction = 1.0;
+    int stack[STATIC_BVH_STACK_SIZE];
+    int n_stack = 0;
+
+    stack[n_stack++] = 0;
+    while (n_stack > 0) {
+        int idx = stack[--n_stack];
+        StaticBvhNode *node = &bvh->nodes[idx];
+
+        float fraction;
+        if (!raycast_aabb(node->aabb, start, end, max_fraction, &fraction)) continue;
+
+        if (node->n_items > 0) {
+            for (int i = 0; i < node->n_items; ++i) {
+                max_fraction = fn(user, node->first + i, max_fraction);
+                if (max_fraction <= 0.0) return;
+            }
+        } else {
+            stack[n_stack++] = node->first;
+            stack[n_stack++] = idx + 1;
+        }
+    }
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "bvh.h"
+#include "raylib.h"
+
+// -----------------------------------------------------------------------
+// static AABB tree
+// built once, top-down with median splits, over geometry that never moves;
+// nodes are stored depth-first in one array and leaves own contiguous item
+// ranges, so the build outputs an order for the caller to lay its items
+// out in, and the ids are positions in that order
+
+#define STATIC_BVH_MAX_LEAF_SIZE 4
+
+// deepest node (the root is at 0) the queries walk to; median splits stay
+// under 32 levels for any item count, mapped levels with a deeper tree are
+// rejected
+#define STATIC_BVH_MAX_DEPTH 63
+
+typedef struct StaticBvhNode {
+    BvhAabb aabb;
+    // inner node: right child (the left one is the next node)
+    // leaf: first item
+    int first;
+    // zero for inner nodes
+    int n_items;
+} StaticBvhNode;
+
+typedef struct StaticBvh {
+    int n_nodes;
+    int capacity;
+    StaticBvhNode *nodes;
+} StaticBvh;
+
+void free_static_bvh(StaticBvh *bvh);
+
+// out_order receives the original index of the item placed at every
+// position
+void build_static_bvh(
+    StaticBvh *bvh,
+    const float *x,
+    const float *y,
+    const float *width,
+    const float *height,
+    int n,
+    int *out_order
+);
+
+int query_static_bvh(StaticBvh *bvh, Rectangle rect, int *out_ids, int max_n_ids);
+void raycast_static_bvh(
+    StaticBvh *bvh, Vector2 start, Vector2 end, BvhRaycastFn fn, void *user
+);
@@ -0,0 +1,92 @@
+#include "tasks.h"
+
+#include "jobs.h"
+#include "profiler.h"
+
+// -----------------------------------------------------------------------
+// graph
+void reset_task_graph(TaskGraph *graph) {
+    graph->n_tasks = 0;
+    graph->n_waves = 0;
+}
+
+static bool is_conflict(const Task *a, const Task *b) {
+    return (a->writes & (b->reads | b->writes)) || (a->reads & b->writes);
+}
+
+// rebuilds the wave order, tasks of a wave keep the order they were added
+static void sort_waves(TaskGraph *graph) {
+    int n = 0;
+    for (int wave = 0; wave < graph->n_waves; ++wave) {
+        for (int i = 0; i < graph->n_tasks; ++i) {
+            if (graph->tasks[i].wave == wave) graph->order[n++] = i;
+        }
+        graph->wave_ends[wave] = n;
+    }
+}
+
+int add_task(
+    TaskGraph *graph,
+    const char *name,
+    TaskFn fn,
+    void *user,
+    uint64_t reads,
+    uint64_t writes
+) {
+    if (graph->n_tasks == MAX_N_TASKS) return -1;
+
+    int idx = graph->n_tasks++;
+    Task *task = &graph->tasks[idx];
+    *task = (Task){
+        .name = name,
+        .fn = fn,
+        .user = user,
+        .reads = reads,
+        .writes = writes,
+    };
+
+    for (int i = 0; i < idx; ++i) {
+        Task *other = &graph->tasks[i];
+        if (!is_conflict(other, task)) continue;
+
+        task->dependencies |= 1u << i;
+        if (other->wave + 1 > task->wave) task->wave = other->wave + 1;
+    }
+
+    if (task->wave + 1 > graph->n_waves) graph->n_waves = task->wave + 1;
+    sort_waves(graph);
+
+    return idx;
+}
+
+// -----------------------------------------------------------------------
+// run
+typedef struct WaveJob {
+    TaskGraph *graph;
+    int begin;
+} WaveJob;
+
+static void run_wave_tasks(void *user, int worker, int begin, int end) {
+    WaveJob *job = user;
+    for (int i = begin; i < end; ++i) {
+        Task *task = &job->graph->tasks[job->graph->order[job->begin + i]];
+        PROFILE_ZONE(task->name);
+        task->fn(task->user);
+    }
+}
+
+void run_task_graph(TaskGraph *graph) {
+    int begin = 0;
+    for (int wave = 0; wave < graph->n_waves; ++wave) {
+        int end = graph->wave_ends[wave];
+        if (end - begin == 1) {
+            Task *task = &graph->tasks[graph->order[begin]];
+            PROFILE_ZONE(task->name);
+            task->fn(task->user);
+        } else {
+            WaveJob job = {.graph = graph, .begin = begin};
+            run_parallel_for(end - begin, 1, run_wave_tasks, &job);
+        }
+        begin = end;
+    }
+}
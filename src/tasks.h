@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdint.h>
+
+// -----------------------------------------------------------------------
+// task graph
+// phases declared with the resources they read and write, as bits of a
+// caller-defined mask. a task depends on every task added before it that
+// writes what it reads or writes, or reads what it writes, so running the
+// graph gives the same results as running the tasks in the order they
+// were added
+//
+// the graph is run in waves: a wave holds the tasks whose dependencies
+// all ran in earlier waves. the tasks of a wave run concurrently on the
+// job pool (and their own parallel-for loops run inline), a wave of one
+// task runs on the calling thread and keeps the whole pool for its loops
+
+#define MAX_N_TASKS 32
+
+typedef void (*TaskFn)(void *user);
+
+typedef struct Task {
+    const char *name;
+    TaskFn fn;
+    void *user;
+
+    uint64_t reads;
+    uint64_t writes;
+
+    // bit per earlier task that must run first
+    uint32_t dependencies;
+    int wave;
+} Task;
+
+typedef struct TaskGraph {
+    int n_tasks;
+    Task tasks[MAX_N_TASKS];
+
+    // task indices sorted by wave, then by the order they were added
+    int n_waves;
+    int order[MAX_N_TASKS];
+    // end of each wave in order
+    int wave_ends[MAX_N_TASKS];
+} TaskGraph;
+
+void reset_task_graph(TaskGraph *graph);
+
+// returns the task index, or -1 if the graph is full
+int add_task(
+    TaskGraph *graph,
+    const char *name,
+    TaskFn fn,
+    void *user,
+    uint64_t reads,
+    uint64_t writes
+);
+
+void run_task_graph(TaskGraph *graph);
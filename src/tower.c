@@ -0,0 +1,358 @@
+#include "tower.h"
+
+#include "sim.h"
+#include <limits.h>
+#include <math.h>
+#include <stdlib.h>
+
+Tower TOWER = {
+    .memory_budget = DEFAULT_TOWER_MEMORY_BUDGET,
+    .first_chunk = 0,
+    .last_chunk = -1,
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .wake_cond = PTHREAD_COND_INITIALIZER,
+    .prefetch_first = 0,
+    .prefetch_last = -1,
+    .prefetch_below = -1,
+};
+
+typedef struct ResidentChunk {
+    ObstacleHandle platforms[TOWER_CHUNK_N_PLATFORMS];
+} ResidentChunk;
+
+// fixed obstacles spanning the window on either side
+static ObstacleHandle WALLS[2];
+
+// -----------------------------------------------------------------------
+// generation
+// the base below chunk 0 counts as chunk 0
+int get_tower_chunk_idx(float y) {
+    double idx = floor((TOWER_BASE_Y - y) / TOWER_CHUNK_HEIGHT);
+    if (!(idx > 0.0)) return 0;
+    return idx < INT_MAX / 2 ? (int)idx : INT_MAX / 2;
+}
+
+// every property is drawn in bulk from its own stream of the level seed,
+// jumped to the chunk's run of draws, so chunk 0 gets the first draws and
+// any chunk can be generated without the ones below it
+void generate_tower_chunk(uint64_t level_seed, int idx, TowerChunk *out_chunk) {
+    uint64_t first_draw = (uint64_t)idx * TOWER_CHUNK_N_PLATFORMS;
+    Rng x_rng = make_rng(level_seed, RNG_STREAM_PLATFORM_X);
+    Rng speed_rng = make_rng(level_seed, RNG_STREAM_PLATFORM_SPEED);
+    advance_rng(&x_rng, first_draw);
+    advance_rng(&speed_rng, first_draw);
+
+    out_chunk->idx = idx;
+    fill_rng_floats_min_max(
+        &x_rng,
+        out_chunk->x,
+        TOWER_CHUNK_N_PLATFORMS,
+        TOWER_PLATFORM_MIN_X,
+        TOWER_PLATFORM_MAX_X
+    );
+    fill_rng_floats_min_max(
+        &speed_rng,
+        out_chunk->speed,
+        TOWER_CHUNK_N_PLATFORMS,
+        TOWER_PLATFORM_MIN_SPEED,
+        TOWER_PLATFORM_MAX_SPEED
+    );
+}
+
+// -----------------------------------------------------------------------
+// resident chunks
+static ResidentChunk *get_resident_chunk(int idx) {
+    return &TOWER.resident[idx % TOWER.max_n_resident_chunks];
+}
+
+// one pair of walls spans the whole window, respawned when it moves: two
+// fixed obstacles in the pool at any time, evicted with the chunks under
+// them
+static void spawn_tower_walls(void) {
+    despawn_obstacle(WALLS[0]);
+    despawn_obstacle(WALLS[1]);
+    if (TOWER.first_chunk > TOWER.last_chunk) return;
+
+    int n_chunks = TOWER.last_chunk - TOWER.first_chunk + 1;
+    Vector2 size = {TOWER_WALL_WIDTH, n_chunks * TOWER_CHUNK_HEIGHT};
+    float top = TOWER_BASE_Y - (TOWER.last_chunk + 1.0) * TOWER_CHUNK_HEIGHT;
+    Vector2 left_wall = {TOWER_LEFT_X, top};
+    Vector2 right_wall = {TOWER_RIGHT_X, top};
+    WALLS[0] = spawn_platform(size, left_wall, left_wall, 0.0, 0.0);
+    WALLS[1] = spawn_platform(size, right_wall, right_wall, 0.0, 0.0);
+}
+
+// the platforms are placed by their phase, so a chunk spawned again is
+// where it would have been
+static void spawn_tower_chunk(const TowerChunk *chunk) {
+    ResidentChunk *resident = get_resident_chunk(chunk->idx);
+
+    Vector2 size = {TOWER_PLATFORM_WIDTH, TOWER_PLATFORM_HEIGHT};
+    for (int i = 0; i < TOWER_CHUNK_N_PLATFORMS; ++i) {
+        int n_below = chunk->idx * TOWER_CHUNK_N_PLATFORMS + i;
+        float y = TOWER_BASE_Y - (n_below + 0.5) * TOWER_PLATFORM_SPACING;
+        Vector2 start = {TOWER_PLATFORM_MIN_X, y};
+        Vector2 end = {TOWER_PLATFORM_MAX_X, y};
+        double phase = chunk->x[i] - TOWER_PLATFORM_MIN_X;
+        resident->platforms[i] = spawn_platform(
+            size, start, end, chunk->speed[i], phase
+        );
+    }
+}
+
+static void evict_tower_chunk(int idx) {
+    ResidentChunk *resident = get_resident_chunk(idx);
+    for (int i = 0; i < TOWER_CHUNK_N_PLATFORMS; ++i) {
+        despawn_obstacle(resident->platforms[i]);
+    }
+}
+
+// -----------------------------------------------------------------------
+// cache
+// the functions below are called with the mutex held
+static bool is_chunk_cached(int idx) {
+    for (int i = 0; i < TOWER_N_CACHED_CHUNKS; ++i) {
+        TowerChunk *chunk = &TOWER.cache[i].chunk;
+        if (chunk->idx == idx && chunk->level == TOWER.level) return true;
+    }
+    return false;
+}
+
+static bool is_chunk_wanted(const TowerChunk *chunk) {
+    if (chunk->idx == -1 || chunk->level != TOWER.level) return false;
+    if (chunk->idx == TOWER.prefetch_below) return true;
+    return chunk->idx >= TOWER.prefetch_first && chunk->idx <= TOWER.prefetch_last;
+}
+
+// the first wanted chunk that isn't cached, -1 if there's none
+static int find_missing_chunk(void) {
+    for (int idx = TOWER.prefetch_first; idx <= TOWER.prefetch_last; ++idx) {
+        if (!is_chunk_cached(idx)) return idx;
+    }
+    int below = TOWER.prefetch_below;
+    if (below != -1 && !is_chunk_cached(below)) return below;
+    return -1;
+}
+
+// a free slot or one holding a chunk no longer wanted, -1 if there's none
+static int find_cache_slot(void) {
+    for (int i = 0; i < TOWER_N_CACHED_CHUNKS; ++i) {
+        if (!is_chunk_wanted(&TOWER.cache[i].chunk)) return i;
+    }
+    return -1;
+}
+
+// -----------------------------------------------------------------------
+// generator
+static void *run_tower_generator(void *user) {
+    pthread_mutex_lock(&TOWER.mutex);
+    for (;;) {
+        int idx = -1;
+        int slot = -1;
+        while (!TOWER.is_stopping) {
+            idx = find_missing_chunk();
+            slot = idx == -1 ? -1 : find_cache_slot();
+            if (slot != -1) break;
+            pthread_cond_wait(&TOWER.wake_cond, &TOWER.mutex);
+        }
+        if (TOWER.is_stopping) break;
+
+        // the slot is taken before generating, so the chunk isn't picked
+        // again meanwhile
+        TowerCacheSlot *cache_slot = &TOWER.cache[slot];
+        uint64_t level = TOWER.level;
+        uint64_t level_seed = TOWER.level_seed;
+        cache_slot->is_ready = false;
+        cache_slot->chunk.idx = idx;
+        cache_slot->chunk.level = level;
+        pthread_mutex_unlock(&TOWER.mutex);
+
+        TowerChunk chunk;
+        generate_tower_chunk(level_seed, idx, &chunk);
+        chunk.level = level;
+
+        // the simulation may have generated it itself (and freed the slot)
+        // or reloaded the level meanwhile
+        pthread_mutex_lock(&TOWER.mutex);
+        if (cache_slot->chunk.idx == idx && cache_slot->chunk.level == level) {
+            cache_slot->chunk = chunk;
+            cache_slot->is_ready = true;
+        }
+    }
+    pthread_mutex_unlock(&TOWER.mutex);
+
+    return NULL;
+}
+
+// takes the chunk out of the cache, returns false if it isn't there (yet)
+static bool take_cached_chunk(int idx, TowerChunk *out_chunk) {
+    bool is_taken = false;
+    pthread_mutex_lock(&TOWER.mutex);
+    for (int i = 0; i < TOWER_N_CACHED_CHUNKS; ++i) {
+        TowerCacheSlot *slot = &TOWER.cache[i];
+        if (slot->chunk.idx != idx || slot->chunk.level != TOWER.level) continue;
+
+        if (slot->is_ready) {
+            *out_chunk = slot->chunk;
+            is_taken = true;
+        }
+        slot->chunk.idx = -1;
+    }
+    pthread_mutex_unlock(&TOWER.mutex);
+
+    return is_taken;
+}
+
+// asks the thread for the chunks around the window
+static void prefetch_tower_chunks(void) {
+    pthread_mutex_lock(&TOWER.mutex);
+    TOWER.prefetch_first = TOWER.last_chunk + 1;
+    TOWER.prefetch_last = TOWER.last_chunk + TOWER_N_CACHED_CHUNKS - 1;
+    TOWER.prefetch_below = TOWER.first_chunk - 1;
+    pthread_cond_signal(&TOWER.wake_cond);
+    pthread_mutex_unlock(&TOWER.mutex);
+}
+
+// -----------------------------------------------------------------------
+// streaming
+// the chunks covering the agents plus the margins, cut down to the budget
+// around agent 0
+static void get_tower_window(int *out_first, int *out_last) {
+    int min_idx = 0;
+    int max_idx = 0;
+    for (int i = 0; i < AGENTS.n; ++i) {
+        int idx = get_tower_chunk_idx(AGENTS.y[i]);
+        if (i == 0 || idx < min_idx) min_idx = idx;
+        if (i == 0 || idx > max_idx) max_idx = idx;
+    }
+
+    int first = min_idx - TOWER_N_CHUNKS_BEHIND;
+    int last = max_idx + TOWER_N_CHUNKS_AHEAD;
+    if (last - first + 1 > TOWER.max_n_resident_chunks) {
+        int focus_idx = AGENTS.n > 0 ? get_tower_chunk_idx(AGENTS.y[0]) : 0;
+        if (last > focus_idx + TOWER_N_CHUNKS_AHEAD) {
+            last = focus_idx + TOWER_N_CHUNKS_AHEAD;
+        }
+        first = last - TOWER.max_n_resident_chunks + 1;
+    }
+
+    *out_first = first < 0 ? 0 : first;
+    *out_last = last;
+}
+
+void update_tower(void) {
+    if (!TOWER.is_enabled) return;
+
+    int first, last;
+    get_tower_window(&first, &last);
+    if (first == TOWER.first_chunk && last == TOWER.last_chunk) return;
+
+    // evicting first frees the resident slots, and going through the
+    // chunks in index order keeps the pool order a function of the window
+    for (int idx = TOWER.first_chunk; idx <= TOWER.last_chunk; ++idx) {
+        if (idx >= first && idx <= last) continue;
+        evict_tower_chunk(idx);
+        TOWER.n_evicted += 1;
+    }
+    for (int idx = first; idx <= last; ++idx) {
+        if (idx >= TOWER.first_chunk && idx <= TOWER.last_chunk) continue;
+
+        TowerChunk chunk;
+        if (take_cached_chunk(idx, &chunk)) {
+            TOWER.n_prefetched += 1;
+        } else {
+            generate_tower_chunk(TOWER.level_seed, idx, &chunk);
+        }
+        spawn_tower_chunk(&chunk);
+        TOWER.n_streamed += 1;
+    }
+
+    TOWER.first_chunk = first;
+    TOWER.last_chunk = last;
+    spawn_tower_walls();
+    int n_resident = last - first + 1;
+    if (n_resident > TOWER.max_n_resident) TOWER.max_n_resident = n_resident;
+
+    prefetch_tower_chunks();
+}
+
+void reset_tower(uint64_t level_seed) {
+    // the cache is paid for first, the window gets what's left but always
+    // fits the margins
+    size_t chunk_size = sizeof(ResidentChunk)
+                        + TOWER_CHUNK_N_PLATFORMS * TOWER_OBSTACLE_SIZE;
+    size_t fixed_size = sizeof(TOWER.cache) + 2 * TOWER_OBSTACLE_SIZE;
+    size_t budget = TOWER.memory_budget > fixed_size ? TOWER.memory_budget - fixed_size
+                                                     : 0;
+    int max_n_resident_chunks = budget / chunk_size;
+    int min_n_resident_chunks = TOWER_N_CHUNKS_BEHIND + TOWER_N_CHUNKS_AHEAD + 1;
+    if (max_n_resident_chunks < min_n_resident_chunks) {
+        max_n_resident_chunks = min_n_resident_chunks;
+    }
+    if (max_n_resident_chunks != TOWER.max_n_resident_chunks) {
+        TOWER.resident = realloc(
+            TOWER.resident, max_n_resident_chunks * sizeof(ResidentChunk)
+        );
+        TOWER.max_n_resident_chunks = max_n_resident_chunks;
+    }
+
+    // the obstacles of the previous level are gone already
+    TOWER.first_chunk = 0;
+    TOWER.last_chunk = -1;
+    WALLS[0] = (ObstacleHandle){0};
+    WALLS[1] = (ObstacleHandle){0};
+    TOWER.is_enabled = true;
+
+    pthread_mutex_lock(&TOWER.mutex);
+    if (!TOWER.is_thread_running) {
+        for (int i = 0; i < TOWER_N_CACHED_CHUNKS; ++i) {
+            TOWER.cache[i].chunk.idx = -1;
+        }
+    }
+    TOWER.level += 1;
+    TOWER.level_seed = level_seed;
+    TOWER.prefetch_first = 0;
+    TOWER.prefetch_last = -1;
+    TOWER.prefetch_below = -1;
+    pthread_mutex_unlock(&TOWER.mutex);
+
+    if (!TOWER.is_thread_running) {
+        pthread_create(&TOWER.thread, NULL, run_tower_generator, NULL);
+        TOWER.is_thread_running = true;
+    }
+
+    update_tower();
+}
+
+void clear_tower(void) {
+    TOWER.is_enabled = false;
+    TOWER.first_chunk = 0;
+    TOWER.last_chunk = -1;
+    WALLS[0] = (ObstacleHandle){0};
+    WALLS[1] = (ObstacleHandle){0};
+
+    pthread_mutex_lock(&TOWER.mutex);
+    TOWER.prefetch_first = 0;
+    TOWER.prefetch_last = -1;
+    TOWER.prefetch_below = -1;
+    pthread_mutex_unlock(&TOWER.mutex);
+}
+
+void free_tower(void) {
+    if (TOWER.is_thread_running) {
+        pthread_mutex_lock(&TOWER.mutex);
+        TOWER.is_stopping = true;
+        pthread_cond_signal(&TOWER.wake_cond);
+        pthread_mutex_unlock(&TOWER.mutex);
+
+        pthread_join(TOWER.thread, NULL);
+        TOWER.is_thread_running = false;
+        TOWER.is_stopping = false;
+    }
+
+    free(TOWER.resident);
+    TOWER.resident = NULL;
+    TOWER.max_n_resident_chunks = 0;
+    TOWER.first_chunk = 0;
+    TOWER.last_chunk = -1;
+}
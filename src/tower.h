@@ -0,0 +1,127 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// -----------------------------------------------------------------------
+// infinite tower
+// the level above the base is split into chunks of platforms between two
+// walls. a chunk is a function of the level seed and its index
+// only, so it can be generated ahead of time, dropped and generated again
+// with the same platforms in the same places
+//
+// the chunks covering the agents (plus a margin above and below) are
+// resident in the obstacle pool, the others are evicted. a background
+// thread generates the next chunks ahead of the window into a small cache,
+// the simulation generates a chunk inline only when the cache missed it;
+// either way it spawns the same obstacles, so the results don't depend on
+// the thread timing. one pair of walls spans the window and moves with it
+//
+// the memory budget bounds the resident chunks plus the cache, when the
+// agents spread over more chunks than it fits the window keeps the part
+// around the first agent (the one the camera follows)
+
+#define TOWER_CHUNK_N_PLATFORMS 10
+#define TOWER_PLATFORM_SPACING 8.0
+#define TOWER_CHUNK_HEIGHT (TOWER_CHUNK_N_PLATFORMS * TOWER_PLATFORM_SPACING)
+
+// chunk 0 starts above the base (ground and stair), chunks go up from it
+#define TOWER_BASE_Y 12.0
+#define TOWER_LEFT_X -20.0
+#define TOWER_RIGHT_X 17.5
+#define TOWER_WALL_WIDTH 2.5
+
+// platforms move left and right between the walls
+#define TOWER_PLATFORM_WIDTH 10.0
+#define TOWER_PLATFORM_HEIGHT 2.5
+#define TOWER_PLATFORM_MIN_X -15.0
+#define TOWER_PLATFORM_MAX_X 5.0
+#define TOWER_PLATFORM_MIN_SPEED 5.0
+#define TOWER_PLATFORM_MAX_SPEED 9.0
+
+#define TOWER_N_CHUNKS_AHEAD 2
+#define TOWER_N_CHUNKS_BEHIND 1
+
+// chunks generated ahead of the window by the background thread: the ones
+// above it and the one below it
+#define TOWER_N_CACHED_CHUNKS 4
+
+// pool arrays, per-obstacle scratch and a broadphase node, rounded up; the
+// budget pays for the walls, then the chunks
+#define TOWER_OBSTACLE_SIZE 128
+#define DEFAULT_TOWER_MEMORY_BUDGET (64 << 10)
+
+// what generation produces, the platform x at world time 0 and speed
+typedef struct TowerChunk {
+    int idx;
+    // level the chunk was generated for
+    uint64_t level;
+    float x[TOWER_CHUNK_N_PLATFORMS];
+    float speed[TOWER_CHUNK_N_PLATFORMS];
+} TowerChunk;
+
+// chunk.idx is -1 if the slot is free, it's set (with the level) when the
+// thread takes the slot and the rest is filled once generated
+typedef struct TowerCacheSlot {
+    bool is_ready;
+    TowerChunk chunk;
+} TowerCacheSlot;
+
+typedef struct Tower {
+    // bytes for the resident chunks and the cache, applied by reset_tower
+    size_t memory_budget;
+    // streaming, between reset_tower and clear_tower
+    bool is_enabled;
+    int max_n_resident_chunks;
+
+    // resident window, inclusive, empty if first > last
+    int first_chunk;
+    int last_chunk;
+    // platforms of the resident chunks by idx % max_n_resident_chunks
+    struct ResidentChunk *resident;
+
+    // generator
+    pthread_t thread;
+    bool is_thread_running;
+    pthread_mutex_t mutex;
+    pthread_cond_t wake_cond;
+
+    // the fields below are guarded by the mutex
+    bool is_stopping;
+    // bumped by every reset, chunks of the earlier levels are dropped
+    uint64_t level;
+    uint64_t level_seed;
+    // chunks to generate ahead: the range above the window, then the one
+    // below it (-1 if none)
+    int prefetch_first;
+    int prefetch_last;
+    int prefetch_below;
+    TowerCacheSlot cache[TOWER_N_CACHED_CHUNKS];
+
+    // chunks spawned, the ones taken from the cache and evicted since the
+    // start, and the most resident at once
+    uint64_t n_streamed;
+    uint64_t n_prefetched;
+    uint64_t n_evicted;
+    int max_n_resident;
+} Tower;
+
+extern Tower TOWER;
+
+int get_tower_chunk_idx(float y);
+void generate_tower_chunk(uint64_t level_seed, int idx, TowerChunk *out_chunk);
+
+// starts the level with an empty window (the obstacles were reset) and
+// streams in the chunks around the agents, starts the thread on first use
+void reset_tower(uint64_t level_seed);
+
+// moves the window to the agents, called once per tick
+void update_tower(void);
+
+// stops streaming until the next reset_tower, for the levels that have no
+// tower (the obstacles were reset)
+void clear_tower(void);
+
+void free_tower(void);
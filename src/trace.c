@@ -0,0 +1,243 @@
+#include "trace.h"
+
+#ifdef PROFILE
+
+#include "profiler.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef enum TraceEventType {
+    TRACE_ZONE,
+    TRACE_COUNTER,
+} TraceEventType;
+
+typedef struct TraceEvent {
+    TraceEventType type;
+    // a string that outlives the trace, a literal or a task name
+    const char *name;
+    uint64_t start;
+    union {
+        uint64_t n_ticks;
+        double value;
+    };
+} TraceEvent;
+
+// the ring of a thread, head is written by the thread only and tail by
+// the writer only, both only grow
+typedef struct TraceThread {
+    struct TraceThread *next;
+    int tid;
+    char name[TRACE_MAX_THREAD_NAME];
+
+    _Atomic uint64_t head;
+    _Atomic uint64_t tail;
+    _Atomic uint64_t n_dropped;
+    TraceEvent events[TRACE_N_EVENTS];
+} TraceThread;
+
+typedef struct Trace {
+    _Atomic bool is_recording;
+    // threads push themselves on the front
+    _Atomic(TraceThread *) threads;
+
+    FILE *file;
+    int pid;
+    uint64_t start;
+    double us_per_tick;
+    bool is_first_event;
+
+    pthread_t writer;
+    _Atomic bool is_stopping;
+} Trace;
+
+static Trace TRACE;
+
+static _Thread_local TraceThread *TRACE_THREAD = NULL;
+// the name given before the thread had a ring
+static _Thread_local const char *TRACE_THREAD_NAME = NULL;
+
+// -----------------------------------------------------------------------
+// recording
+static TraceThread *get_trace_thread(void) {
+    if (TRACE_THREAD) return TRACE_THREAD;
+
+    TraceThread *thread = calloc(1, sizeof(TraceThread));
+    thread->tid = syscall(SYS_gettid);
+    if (TRACE_THREAD_NAME) {
+        snprintf(thread->name, sizeof(thread->name), "%s", TRACE_THREAD_NAME);
+    }
+    thread->next = atomic_load(&TRACE.threads);
+    while (!atomic_compare_exchange_weak(&TRACE.threads, &thread->next, thread)) {
+    }
+    TRACE_THREAD = thread;
+    return thread;
+}
+
+static void push_trace_event(TraceEvent event) {
+    TraceThread *thread = get_trace_thread();
+    uint64_t head = atomic_load_explicit(&thread->head, memory_order_relaxed);
+    uint64_t tail = atomic_load_explicit(&thread->tail, memory_order_acquire);
+    if (head - tail == TRACE_N_EVENTS) {
+        atomic_fetch_add_explicit(&thread->n_dropped, 1, memory_order_relaxed);
+        return;
+    }
+    thread->events[head % TRACE_N_EVENTS] = event;
+    atomic_store_explicit(&thread->head, head + 1, memory_order_release);
+}
+
+bool is_trace_recording(void) {
+    return atomic_load_explicit(&TRACE.is_recording, memory_order_relaxed);
+}
+
+void record_trace_zone(const char *name, uint64_t start, uint64_t n_ticks) {
+    if (!is_trace_recording()) return;
+    TraceEvent event = {.type = TRACE_ZONE, .name = name, .start = start};
+    event.n_ticks = n_ticks;
+    push_trace_event(event);
+}
+
+void record_trace_counter(const char *name, double value) {
+    if (!is_trace_recording()) return;
+    TraceEvent event = {.type = TRACE_COUNTER, .name = name};
+    event.start = read_profile_clock();
+    event.value = value;
+    push_trace_event(event);
+}
+
+void name_trace_thread(const char *name) {
+    TRACE_THREAD_NAME = name;
+    if (TRACE_THREAD == NULL) return;
+    snprintf(TRACE_THREAD->name, sizeof(TRACE_THREAD->name), "%s", name);
+}
+
+// -----------------------------------------------------------------------
+// writer
+static double get_trace_us(uint64_t ticks) {
+    // events started just before the trace did are clamped to its start
+    return ticks > TRACE.start ? (ticks - TRACE.start) * TRACE.us_per_tick : 0.0;
+}
+
+static void write_trace_separator(void) {
+    if (!TRACE.is_first_event) fputs(",\n", TRACE.file);
+    TRACE.is_first_event = false;
+}
+
+static void write_trace_event(const TraceThread *thread, const TraceEvent *event) {
+    write_trace_separator();
+    if (event->type == TRACE_ZONE) {
+        fprintf(
+            TRACE.file,
+            "{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+            "\"pid\":%d,\"tid\":%d}",
+            event->name,
+            get_trace_us(event->start),
+            event->n_ticks * TRACE.us_per_tick,
+            TRACE.pid,
+            thread->tid
+        );
+    } else {
+        fprintf(
+            TRACE.file,
+            "{\"name\":\"%s\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d,"
+            "\"args\":{\"value\":%.17g}}",
+            event->name,
+            get_trace_us(event->start),
+            TRACE.pid,
+            thread->tid,
+            event->value
+        );
+    }
+}
+
+static void flush_trace(void) {
+    TraceThread *thread = atomic_load(&TRACE.threads);
+    for (; thread; thread = thread->next) {
+        uint64_t tail = atomic_load_explicit(&thread->tail, memory_order_relaxed);
+        uint64_t head = atomic_load_explicit(&thread->head, memory_order_acquire);
+        for (; tail < head; ++tail) {
+            write_trace_event(thread, &thread->events[tail % TRACE_N_EVENTS]);
+        }
+        atomic_store_explicit(&thread->tail, tail, memory_order_release);
+    }
+}
+
+static void *run_trace_writer(void *arg) {
+    struct timespec ts = {.tv_nsec = TRACE_FLUSH_INTERVAL_NS};
+    while (!atomic_load(&TRACE.is_stopping)) {
+        nanosleep(&ts, NULL);
+        flush_trace();
+    }
+    return NULL;
+}
+
+// -----------------------------------------------------------------------
+// trace
+bool start_trace(const char *path) {
+    if (TRACE.file) return false;
+    TRACE.file = fopen(path, "w");
+    if (TRACE.file == NULL) return false;
+
+    TRACE.pid = getpid();
+    TRACE.start = read_profile_clock();
+    TRACE.us_per_tick = get_profile_us_per_tick();
+    TRACE.is_first_event = true;
+    fputs("{\"traceEvents\":[\n", TRACE.file);
+
+    // the events older than the trace are left out
+    TraceThread *thread = atomic_load(&TRACE.threads);
+    for (; thread; thread = thread->next) {
+        atomic_store(&thread->tail, atomic_load(&thread->head));
+    }
+
+    atomic_store(&TRACE.is_stopping, false);
+    if (pthread_create(&TRACE.writer, NULL, run_trace_writer, NULL) != 0) {
+        fclose(TRACE.file);
+        TRACE.file = NULL;
+        return false;
+    }
+    atomic_store(&TRACE.is_recording, true);
+    return true;
+}
+
+uint64_t stop_trace(void) {
+    if (TRACE.file == NULL) return 0;
+    atomic_store(&TRACE.is_recording, false);
+    atomic_store(&TRACE.is_stopping, true);
+    pthread_join(TRACE.writer, NULL);
+    flush_trace();
+
+    uint64_t n_dropped = 0;
+    TraceThread *thread = atomic_exchange(&TRACE.threads, NULL);
+    while (thread) {
+        if (thread->name[0]) {
+            write_trace_separator();
+            fprintf(
+                TRACE.file,
+                "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+                "\"args\":{\"name\":\"%s\"}}",
+                TRACE.pid,
+                thread->tid,
+                thread->name
+            );
+        }
+        n_dropped += atomic_load(&thread->n_dropped);
+
+        TraceThread *next = thread->next;
+        free(thread);
+        thread = next;
+    }
+    TRACE_THREAD = NULL;
+
+    fputs("\n],\"displayTimeUnit\":\"ms\"}\n", TRACE.file);
+    fclose(TRACE.file);
+    TRACE.file = NULL;
+    return n_dropped;
+}
+
+#endif
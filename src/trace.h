@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// -----------------------------------------------------------------------
+// trace recorder
+// while a trace is recording, every profiler zone (see ./src/profiler.h)
+// and counter is also written as a trace event, with the thread it ran
+// on, to a Chrome trace-event JSON file that chrome://tracing and the
+// Perfetto UI open as a timeline
+//
+// a thread appends its events to its own ring, and only a writer thread
+// takes them out, so recording is a few stores with no lock. the writer
+// flushes the rings every TRACE_FLUSH_INTERVAL_NS; a thread whose ring
+// is full drops its events until then, and the drops are counted
+//
+// part of the PROFILE=1 builds, like the zones
+
+#define TRACE_N_EVENTS (1 << 15)
+#define TRACE_FLUSH_INTERVAL_NS 10000000
+#define TRACE_MAX_THREAD_NAME 32
+
+#ifdef PROFILE
+
+// returns false if the file can't be written, or a trace is recording
+bool start_trace(const char *path);
+
+// writes the rest of the events and closes the file, returns the number
+// of dropped events. the threads that recorded, but the caller's, must
+// be stopped: their rings are freed
+uint64_t stop_trace(void);
+
+bool is_trace_recording(void);
+
+// called by the profiler, start and duration in profiler clock ticks
+void record_trace_zone(const char *name, uint64_t start, uint64_t n_ticks);
+void record_trace_counter(const char *name, double value);
+
+// names the calling thread in the trace, before or while recording
+void name_trace_thread(const char *name);
+
+#endif
@@ -0,0 +1,28 @@
+#include "triple_buffer.h"
+
+void init_triple_buffer(TripleBuffer *buffer) {
+    buffer->write_slot = 0;
+    buffer->read_slot = 1;
+    atomic_init(&buffer->middle, 2);
+}
+
+// the exchange releases the written slot to the reader and acquires the
+// slot the reader let go of
+int publish_triple_buffer(TripleBuffer *buffer) {
+    int slot = buffer->write_slot | TRIPLE_BUFFER_FRESH;
+    int middle = atomic_exchange_explicit(&buffer->middle, slot, memory_order_acq_rel);
+    buffer->write_slot = middle & ~TRIPLE_BUFFER_FRESH;
+    return buffer->write_slot;
+}
+
+int acquire_triple_buffer(TripleBuffer *buffer) {
+    int middle = atomic_load_explicit(&buffer->middle, memory_order_relaxed);
+    if (!(middle & TRIPLE_BUFFER_FRESH)) return buffer->read_slot;
+
+    // only the writer sets the fresh bit, so the middle is still fresh here
+    middle = atomic_exchange_explicit(
+        &buffer->middle, buffer->read_slot, memory_order_acq_rel
+    );
+    buffer->read_slot = middle & ~TRIPLE_BUFFER_FRESH;
+    return buffer->read_slot;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdatomic.h>
+
+// -----------------------------------------------------------------------
+// triple buffer
+// hands the latest state from one writer thread to one reader thread with
+// no locks and no waiting: the writer fills its slot and swaps it with the
+// middle one, the reader swaps its slot with the middle one when a newer
+// state was published there. neither touches the other's slot, the states
+// the reader doesn't get to in time are dropped
+// the caller keeps the slots, the buffer only deals the indices
+
+#define TRIPLE_BUFFER_N_SLOTS 3
+
+// set on the middle slot index from the publish until the reader takes it
+#define TRIPLE_BUFFER_FRESH 4
+
+typedef struct TripleBuffer {
+    // owned by the writer and the reader
+    int write_slot;
+    int read_slot;
+
+    // slot index, with TRIPLE_BUFFER_FRESH if it's newer than the read one
+    _Atomic int middle;
+} TripleBuffer;
+
+void init_triple_buffer(TripleBuffer *buffer);
+
+// makes the write slot the latest state, returns the slot to write next
+int publish_triple_buffer(TripleBuffer *buffer);
+
+// takes the latest state if one was published since the last call,
+// returns the slot to read (the same as before if there was none)
+int acquire_triple_buffer(TripleBuffer *buffer);